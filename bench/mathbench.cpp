@@ -0,0 +1,94 @@
+// Micro-benchmark of the Mat4 operations: scalar implementation vs the one selected at compile time
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "mat.h"
+
+namespace {
+
+constexpr int kCount = 1024;
+constexpr int kRepetitions = 2000;
+
+// Force the compiler to assume that memory is read and written, so that the repetitions are not merged
+inline void ClobberMemory() {
+#if defined(_MSC_VER)
+	_ReadWriteBarrier();
+#else
+	asm volatile("" : : : "memory");
+#endif
+}
+
+template <typename Fn>
+double Measure(Fn&& fn) {
+	const auto start = std::chrono::steady_clock::now();
+	for (int r = 0; r < kRepetitions; ++r) {
+		fn();
+		ClobberMemory();
+	}
+	const auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::nano>(end - start).count() / (double(kRepetitions) * kCount);
+}
+
+void Report(const char* name, double scalarNs, double dispatchNs) {
+	std::printf("%-10s %10.2f %10.2f %8.2fx\n", name, scalarNs, dispatchNs, scalarNs / dispatchNs);
+}
+
+}
+
+int main(void) {
+
+	std::mt19937 rng(42);
+	std::uniform_real_distribution<float> dist(-1.f, 1.f);
+
+	std::vector<Mat4> mats(kCount);
+	std::vector<Vec4> vecs(kCount);
+	for (int i = 0; i < kCount; ++i) {
+		for (int j = 0; j < 16; ++j) {
+			mats[i][j] = dist(rng);
+		}
+		mats[i] = mats[i] + Mat4(4.f);	// Keep them invertible
+		vecs[i] = { dist(rng), dist(rng), dist(rng), 1.f };
+	}
+	std::vector<Mat4> outMats(kCount);
+	std::vector<Vec4> outVecs(kCount);
+
+#if defined(RASTERIZER_SSE2)
+	std::printf("Compiled with SSE2%s\n", 
+#if defined(RASTERIZER_AVX2)
+		", AVX2"
+#else
+		""
+#endif
+	);
+#else
+	std::printf("Compiled without SIMD, both columns use the scalar path\n");
+#endif
+	std::printf("%-10s %10s %10s %9s\n", "ns/op", "scalar", "dispatch", "speedup");
+
+	Report("mul",
+		Measure([&] { for (int i = 0; i < kCount; ++i) outMats[i] = scalar::mul(mats[i], mats[(i + 1) % kCount]); }),
+		Measure([&] { for (int i = 0; i < kCount; ++i) outMats[i] = mats[i] * mats[(i + 1) % kCount]; }));
+	Report("transform",
+		Measure([&] { for (int i = 0; i < kCount; ++i) outVecs[i] = scalar::mul(mats[i], vecs[i]); }),
+		Measure([&] { for (int i = 0; i < kCount; ++i) outVecs[i] = mats[i] * vecs[i]; }));
+	Report("transpose",
+		Measure([&] { for (int i = 0; i < kCount; ++i) outMats[i] = scalar::transpose(mats[i]); }),
+		Measure([&] { for (int i = 0; i < kCount; ++i) outMats[i] = transpose(mats[i]); }));
+	Report("inverse",
+		Measure([&] { for (int i = 0; i < kCount; ++i) outMats[i] = scalar::inverse(mats[i]); }),
+		Measure([&] { for (int i = 0; i < kCount; ++i) outMats[i] = inverse(mats[i]); }));
+
+	// Keep the results alive
+	float sum = 0.f;
+	for (int i = 0; i < kCount; ++i) {
+		sum += outMats[i][0] + outVecs[i][0];
+	}
+	std::printf("(checksum %f)\n", sum);
+}
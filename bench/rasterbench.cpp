@@ -0,0 +1,626 @@
+// Benchmark of the pipeline on synthetic scenes. The stages are first timed one by one on a single
+// thread (vertex, setup, raster, shade, blend), then whole draws in each raster mode, and the scene
+// split into many small draws, drawn one by one or submitted with a command list. Draws with a frame
+// arena are measured once it is warmed up, in the steady state.
+//
+// rasterizer_bench [--scene name] [--repetitions n] [--json file]
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <new>
+#include <optional>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "vec.h"
+#include "mat.h"
+#include "vertex.h"
+#include "fragment.h"
+#include "texture.h"
+#include "framebuffer.h"
+#include "arena.h"
+#include "pipeline.h"
+#include "commands.h"
+#include "simd.h"
+
+namespace {
+
+// Heap usage of the process, tracked by the replacements of operator new and delete below
+std::atomic<int64_t> heapCurrent = 0;
+std::atomic<int64_t> heapPeak = 0;
+
+struct AllocationHeader {
+	void* base;
+	size_t size;
+};
+
+void* Allocate(size_t size, size_t align) {
+
+	align = std::max(align, alignof(std::max_align_t));
+	void* base = std::malloc(size + align + sizeof(AllocationHeader));
+	if (!base) {
+		throw std::bad_alloc();
+	}
+	const uintptr_t ptr = (reinterpret_cast<uintptr_t>(base) + sizeof(AllocationHeader) + align - 1) & ~(uintptr_t(align) - 1);
+	AllocationHeader* header = reinterpret_cast<AllocationHeader*>(ptr) - 1;
+	header->base = base;
+	header->size = size;
+
+	const int64_t current = heapCurrent += size;
+	int64_t peak = heapPeak.load();
+	while (current > peak && !heapPeak.compare_exchange_weak(peak, current)) {}
+	return reinterpret_cast<void*>(ptr);
+}
+
+void Deallocate(void* ptr) {
+	if (ptr) {
+		const AllocationHeader* header = reinterpret_cast<AllocationHeader*>(ptr) - 1;
+		heapCurrent -= header->size;
+		std::free(header->base);
+	}
+}
+
+}
+
+void* operator new(size_t size) { return Allocate(size, 0); }
+void* operator new[](size_t size) { return Allocate(size, 0); }
+void* operator new(size_t size, std::align_val_t align) { return Allocate(size, static_cast<size_t>(align)); }
+void* operator new[](size_t size, std::align_val_t align) { return Allocate(size, static_cast<size_t>(align)); }
+void operator delete(void* ptr) noexcept { Deallocate(ptr); }
+void operator delete[](void* ptr) noexcept { Deallocate(ptr); }
+void operator delete(void* ptr, size_t) noexcept { Deallocate(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { Deallocate(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { Deallocate(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { Deallocate(ptr); }
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept { Deallocate(ptr); }
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept { Deallocate(ptr); }
+
+namespace {
+
+constexpr int kWidth = 1920;
+constexpr int kHeight = 1080;
+
+// Triangles of each draw of the split scenes
+constexpr size_t kSmallDrawTriangles = 64;
+
+// Fragments shaded at once by the shade and blend stages, to bound the memory of the benchmark
+constexpr size_t kFragmentChunk = size_t(1) << 20;
+
+using FB = BasicFramebuffer<ColorRGBA8, Depth24, TiledLayout<8>>;
+using VertIn = std::tuple<Vec3, Vec2>;
+using VertOut = Vertex<Vec2>;
+
+using Clock = std::chrono::steady_clock;
+
+// Keeps the results of the measured loops alive
+volatile float sink;
+
+// Duration and peak heap usage of the measured parts of a run
+struct StageClock {
+
+	double ms = 0.;
+	int64_t peakBytes = 0;
+
+	template <typename Fn>
+	void measure(Fn&& fn) {
+		const int64_t base = heapCurrent.load();
+		heapPeak = base;
+		const Clock::time_point start = Clock::now();
+		fn();
+		ms += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		peakBytes = std::max(peakBytes, heapPeak.load() - base);
+	}
+
+};
+
+struct Stage {
+	std::string name;
+	double ms = std::numeric_limits<double>::max();	// Fastest of the repetitions
+	int64_t peakBytes = 0;	// Largest of the repetitions, allocated by the stage
+
+	void add(const StageClock& clock) {
+		ms = std::min(ms, clock.ms);
+		peakBytes = std::max(peakBytes, clock.peakBytes);
+	}
+};
+
+template <typename Fn>
+Stage MeasureStage(const char* name, int repetitions, Fn&& run) {
+	Stage stage{ name };
+	for (int r = 0; r < repetitions; ++r) {
+		StageClock clock;
+		run(clock);
+		stage.add(clock);
+	}
+	return stage;
+}
+
+struct Scene {
+	std::string name;
+	std::vector<VertIn> vertices = {};
+	CubeVertShader vShader = {};	// Identity matrices by default: positions in NDC
+};
+
+struct SceneResult {
+	std::string name;
+	size_t triangles = 0;
+	size_t setupTriangles = 0;	// After clipping and rejection
+	uint64_t fragments = 0;
+	std::vector<Stage> stages;
+};
+
+// Cheap shader, so that the other stages dominate
+struct GradientShader {
+	float alpha = 1.f;
+	Vec4 operator()(Vec3, Vec2 tex) const {
+		return { tex.x, tex.y, 0.5f, alpha };
+	}
+};
+
+// Multisampled binned draw, resolved to framebuffer
+template <int samples, typename State, typename Frag>
+Stage MeasureMultisampleDraw(const char* name, const Scene& scene, const Frag& fShader, FB& framebuffer, int repetitions) {
+
+	BasicFramebuffer<ColorRGBA8, Depth24, TiledLayout<8>, samples> multisampled(kWidth, kHeight);
+	DrawOptions options;
+	options.mode = RasterMode::Binned;
+
+	return MeasureStage(name, repetitions, [&](StageClock& clock) {
+		multisampled.clear({ 0.f, 0.f, 0.f, 1.f });
+		clock.measure([&] {
+			DrawTriangles<State>(multisampled, std::span<const VertIn>(scene.vertices), scene.vShader, fShader, options);
+			Resolve(multisampled, framebuffer);
+			});
+		});
+}
+
+// draw(options) measured as a stage. With a frame arena in the options, the arena is reset before
+// each run and warmed up by a first run, so that the peak heap memory is that of the steady state.
+template <typename DrawFn>
+Stage MeasureDraw(const char* name, FB& framebuffer, const DrawOptions& options, int repetitions, DrawFn&& draw) {
+	if (options.arena) {
+		framebuffer.clear({ 0.f, 0.f, 0.f, 1.f });
+		options.arena->reset();
+		draw(options);
+	}
+	return MeasureStage(name, repetitions, [&](StageClock& clock) {
+		framebuffer.clear({ 0.f, 0.f, 0.f, 1.f });
+		if (options.arena) {
+			options.arena->reset();
+		}
+		clock.measure([&] {
+			draw(options);
+			});
+		});
+}
+
+// The scene split into small binned draws, drawn by separate calls or by a command list, with and
+// without a frame arena
+template <typename State, typename Frag>
+void MeasureSmallDraws(SceneResult& res, const Scene& scene, const Frag& fShader, FB& framebuffer, int repetitions) {
+
+	const std::span<const VertIn> vertices(scene.vertices);
+	constexpr size_t drawVertices = kSmallDrawTriangles * 3;
+	DrawOptions options;
+	options.mode = RasterMode::Binned;
+	FrameArena arena;
+	DrawOptions arenaOptions = options;
+	arenaOptions.arena = &arena;
+
+	const auto separate = [&](const DrawOptions& drawOptions) {
+		for (size_t start = 0; start < vertices.size(); start += drawVertices) {
+			DrawTriangles<State>(framebuffer, vertices.subspan(start, std::min(drawVertices, vertices.size() - start)),
+				scene.vShader, fShader, drawOptions);
+		}
+	};
+	res.stages.push_back(MeasureDraw("draws_separate", framebuffer, options, repetitions, separate));
+	res.stages.push_back(MeasureDraw("draws_separate_arena", framebuffer, arenaOptions, repetitions, separate));
+
+	CommandList<FB> commands;
+	const auto commandList = [&](const DrawOptions& drawOptions) {
+		commands.clear();
+		for (size_t start = 0; start < vertices.size(); start += drawVertices) {
+			commands.draw<State>(vertices.subspan(start, std::min(drawVertices, vertices.size() - start)), scene.vShader, fShader);
+		}
+		commands.submit(framebuffer, drawOptions);
+	};
+	res.stages.push_back(MeasureDraw("draws_command_list", framebuffer, options, repetitions, commandList));
+	res.stages.push_back(MeasureDraw("draws_command_list_arena", framebuffer, arenaOptions, repetitions, commandList));
+}
+
+template <typename State, typename Frag>
+SceneResult RunScene(const Scene& scene, const Frag& fShader, int repetitions) {
+
+	constexpr bool derivatives = UsesDerivatives<Frag, FragmentOf<VertOut>>::value;
+
+	SceneResult res;
+	res.name = scene.name;
+	res.triangles = scene.vertices.size() / 3;
+
+	DrawOptions serial;
+	serial.threads = 1;
+	FB framebuffer(kWidth, kHeight);
+
+	std::vector<VertOut> shaded;
+	res.stages.push_back(MeasureStage("vertex", repetitions, [&](StageClock& clock) {
+		shaded = {};
+		clock.measure([&] {
+			shaded.resize(scene.vertices.size());
+			ShadeVertices(scene.vShader, std::span<const VertIn>(scene.vertices), std::span<VertOut>(shaded), serial);
+			});
+		}));
+
+	// Clipping appends to the vertices
+	std::vector<VertOut> verts;
+	ArenaVector<Triangle> triangles;
+	res.stages.push_back(MeasureStage("setup", repetitions, [&](StageClock& clock) {
+		verts = shaded;
+		triangles = {};
+		clock.measure([&] {
+			triangles = AssembleTriangles(verts, std::views::iota(uint32_t(0), static_cast<uint32_t>(verts.size())),
+				kWidth, kHeight, DrawCullMode<State>(serial), serial.frontFace);
+			});
+		}));
+	res.setupTriangles = triangles.size();
+
+	res.stages.push_back(MeasureStage("raster", repetitions, [&](StageClock& clock) {
+		uint64_t fragments = 0;
+		float sum = 0.f;
+		clock.measure([&] {
+			for (const Triangle& tri : triangles) {
+				RasterizeTriangle(tri, 0, 0, kWidth, kHeight, [&](float, float, float wa, float wb, float) {
+					sum += wa + wb;
+					++fragments;
+					});
+			}
+			});
+		res.fragments = fragments;
+		sink = sum;
+		}));
+
+	// Every fragment is interpolated and shaded, without depth test, then depth tested and blended.
+	// The blocks are rasterized beforehand, by chunks.
+	struct BlockRecord {
+		uint32_t triangle;
+		RasterBlock block;
+	};
+	struct ShadedFragment {
+		int x, y;
+		float z;
+		Vec4 color;
+	};
+	std::vector<BlockRecord> blocks;
+	std::vector<ShadedFragment> fragments;
+	fragments.reserve(kFragmentChunk + kBlockSize * kBlockSize);
+	blocks.reserve(kFragmentChunk);
+
+	Stage shade{ "shade" };
+	Stage blend{ "blend" };
+	for (int r = 0; r < repetitions; ++r) {
+		framebuffer.clear({ 0.f, 0.f, 0.f, 1.f });
+		StageClock shadeClock;
+		StageClock blendClock;
+		Frag shader = fShader;
+
+		const auto flush = [&] {
+			shadeClock.measure([&] {
+				uint32_t current = VisibilityBuffer::kNoTriangle;
+				std::optional<TriangleAttributes<VertOut>> attrs;
+				for (const BlockRecord& record : blocks) {
+					const Triangle& tri = triangles[record.triangle];
+					if (record.triangle != current) {
+						current = record.triangle;
+						attrs.emplace(verts[tri.a], verts[tri.b], verts[tri.c]);
+					}
+					[[maybe_unused]] QuadDerivativesCache<VertOut> quads;
+					ForEachPixel(tri, record.block, [&](float x, float y, float wa, float wb, float wc) {
+						const float z = framebuffer.quantizeDepth(InterpolateDepth(tri, verts[tri.a], verts[tri.b], verts[tri.c], wa, wb, wc));
+						const auto frag = InterpolateFragment(*attrs, x, y, z, wa, wb, wc);
+						Vec4 color;
+						if constexpr (derivatives) {
+							color = ShadeFragment(shader, frag, quads.get(tri, record.block, *attrs, static_cast<int>(x), static_cast<int>(y)));
+						}
+						else {
+							color = ShadeFragment(shader, frag);
+						}
+						fragments.push_back({ static_cast<int>(x), static_cast<int>(y), z, color });
+						});
+				}
+				});
+			blendClock.measure([&] {
+				for (const ShadedFragment& frag : fragments) {
+					WriteFragment<State>(framebuffer, frag.x, frag.y, frag.z, frag.color);
+				}
+				});
+			blocks.clear();
+			fragments.clear();
+		};
+
+		size_t chunkFragments = 0;
+		for (uint32_t i = 0; i < triangles.size(); ++i) {
+			RasterizeBlocks(triangles[i], 0, 0, kWidth, kHeight, [](int, int) { return true; }, [&](const RasterBlock& block) {
+				blocks.push_back({ i, block });
+				chunkFragments += std::popcount(block.mask);
+				if (chunkFragments >= kFragmentChunk) {
+					flush();
+					chunkFragments = 0;
+				}
+				});
+		}
+		flush();
+
+		shade.add(shadeClock);
+		blend.add(blendClock);
+	}
+	res.stages.push_back(shade);
+	res.stages.push_back(blend);
+
+	// Whole draws, vertex processing included
+	FrameArena arena;
+	const std::tuple<const char*, RasterMode, FrameArena*> modes[] = {
+		{ "draw_immediate", RasterMode::Immediate, nullptr },
+		{ "draw_streaming", RasterMode::Streaming, nullptr },
+		{ "draw_binned", RasterMode::Binned, nullptr },
+		{ "draw_binned_arena", RasterMode::Binned, &arena },
+		{ "draw_deferred", RasterMode::Deferred, nullptr },
+		{ "draw_deferred_arena", RasterMode::Deferred, &arena },
+	};
+	for (const auto& [name, mode, modeArena] : modes) {
+		DrawOptions options;
+		options.mode = mode;
+		options.arena = modeArena;
+		res.stages.push_back(MeasureDraw(name, framebuffer, options, repetitions, [&](const DrawOptions& drawOptions) {
+			DrawTriangles<State>(framebuffer, std::span<const VertIn>(scene.vertices), scene.vShader, fShader, drawOptions);
+			}));
+	}
+	res.stages.push_back(MeasureMultisampleDraw<4, State>("draw_msaa4", scene, fShader, framebuffer, repetitions));
+	res.stages.push_back(MeasureMultisampleDraw<8, State>("draw_msaa8", scene, fShader, framebuffer, repetitions));
+	MeasureSmallDraws<State>(res, scene, fShader, framebuffer, repetitions);
+
+	return res;
+}
+
+// Random triangles of about one pixel
+Scene TinyTriangles() {
+
+	Scene scene{ "tiny_triangles" };
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> pos(-1.f, 1.f);
+	std::uniform_real_distribution<float> offset(-1.5f, 1.5f);
+	std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+	for (int i = 0; i < 300000; ++i) {
+		const Vec3 center{ pos(rng), pos(rng), pos(rng) * 0.9f };
+		for (int k = 0; k < 3; ++k) {
+			const Vec3 p{ center.x + offset(rng) * 2.f / kWidth, center.y + offset(rng) * 2.f / kHeight, center.z };
+			scene.vertices.push_back({ p, Vec2{ unit(rng), unit(rng) } });
+		}
+	}
+	return scene;
+}
+
+// A few triangles each covering the whole screen, at random depths
+Scene HugeTriangles() {
+
+	Scene scene{ "huge_triangles" };
+	std::mt19937 rng(2);
+	std::uniform_real_distribution<float> depth(-0.9f, 0.9f);
+	std::uniform_real_distribution<float> angle(0.f, 2.f * 3.14159265f);
+
+	for (int i = 0; i < 24; ++i) {
+		// Circumscribed to a circle of radius 1.5 around the center, so that the screen is covered
+		const float start = angle(rng);
+		for (int k = 0; k < 3; ++k) {
+			const float a = start + k * 2.f * 3.14159265f / 3.f;
+			const Vec3 p{ 3.f * std::cos(a), 3.f * std::sin(a), depth(rng) };
+			scene.vertices.push_back({ p, Vec2{ 0.5f + 0.5f * std::cos(a), 0.5f + 0.5f * std::sin(a) } });
+		}
+	}
+	return scene;
+}
+
+// Translucent quads from back to front, so that every fragment is blended
+Scene AlphaOverdraw() {
+
+	Scene scene{ "alpha_overdraw" };
+	std::mt19937 rng(3);
+	std::uniform_real_distribution<float> pos(-1.f, 1.f);
+
+	constexpr int quads = 50;
+	constexpr float size = 0.7f;
+	for (int i = 0; i < quads; ++i) {
+		const float x = pos(rng) * (1.f - size / 2.f);
+		const float y = pos(rng) * (1.f - size / 2.f);
+		const float z = 0.9f - 1.8f * i / quads;
+		const Vec3 corners[4] = { { x - size, y - size, z }, { x + size, y - size, z }, { x + size, y + size, z }, { x - size, y + size, z } };
+		const Vec2 tex[4] = { { 0.f, 0.f }, { 1.f, 0.f }, { 1.f, 1.f }, { 0.f, 1.f } };
+		for (int k : { 0, 1, 2, 2, 3, 0 }) {
+			scene.vertices.push_back({ corners[k], tex[k] });
+		}
+	}
+	return scene;
+}
+
+// Append a w x h grid of quads, from origin along the axes u and v, with texture coordinates up to texScale
+void AddGrid(std::vector<VertIn>& vertices, const Vec3& origin, const Vec3& u, const Vec3& v, int w, int h, float texScale) {
+	for (int j = 0; j < h; ++j) {
+		for (int i = 0; i < w; ++i) {
+			const Vec2 cell[4] = { { float(i), float(j) }, { float(i + 1), float(j) }, { float(i + 1), float(j + 1) }, { float(i), float(j + 1) } };
+			for (int k : { 0, 1, 2, 2, 3, 0 }) {
+				const Vec3 p = origin + u * (cell[k].x / w) + v * (cell[k].y / h);
+				vertices.push_back({ p, Vec2{ cell[k].x / w * texScale, cell[k].y / h * texScale } });
+			}
+		}
+	}
+}
+
+// A textured ground plane seen at a grazing angle, the texture repeated many times
+Scene TextureMinification() {
+
+	Scene scene{ "texture_minification" };
+	AddGrid(scene.vertices, { -50.f, -1.f, -0.5f }, { 100.f, 0.f, 0.f }, { 0.f, 0.f, -100.f }, 16, 16, 400.f);
+
+	scene.vShader.view = lookAt({ 0.f, 0.f, 0.f }, { 0.f, -0.1f, -1.f }, { 0.f, 1.f, 0.f });
+	scene.vShader.projection = projection(3.14159265f / 3.f, float(kWidth) / kHeight, 0.1f, 200.f);
+	return scene;
+}
+
+// The camera inside a room, with triangles all around it: many cross the near plane and are clipped
+Scene NearPlane() {
+
+	Scene scene{ "near_plane" };
+	const Vec3 lo{ -4.f, -1.5f, -8.f };
+	const Vec3 hi{ 4.f, 2.5f, 2.f };
+	const Vec3 size = hi - lo;
+	AddGrid(scene.vertices, lo, { size.x, 0.f, 0.f }, { 0.f, 0.f, size.z }, 16, 16, 8.f);		// floor
+	AddGrid(scene.vertices, { lo.x, hi.y, lo.z }, { 0.f, 0.f, size.z }, { size.x, 0.f, 0.f }, 16, 16, 8.f);	// ceiling
+	AddGrid(scene.vertices, lo, { 0.f, size.y, 0.f }, { 0.f, 0.f, size.z }, 16, 16, 8.f);		// left
+	AddGrid(scene.vertices, { hi.x, lo.y, lo.z }, { 0.f, 0.f, size.z }, { 0.f, size.y, 0.f }, 16, 16, 8.f);	// right
+	AddGrid(scene.vertices, lo, { size.x, 0.f, 0.f }, { 0.f, size.y, 0.f }, 16, 16, 8.f);		// far wall
+
+	std::mt19937 rng(5);
+	std::uniform_real_distribution<float> pos(-3.f, 3.f);
+	std::uniform_real_distribution<float> offset(-0.4f, 0.4f);
+	std::uniform_real_distribution<float> unit(0.f, 1.f);
+	for (int i = 0; i < 3000; ++i) {
+		const Vec3 center{ pos(rng), pos(rng) * 0.5f, pos(rng) };
+		for (int k = 0; k < 3; ++k) {
+			scene.vertices.push_back({ center + Vec3{ offset(rng), offset(rng), offset(rng) }, Vec2{ unit(rng), unit(rng) } });
+		}
+	}
+
+	scene.vShader.view = lookAt({ 0.f, 0.f, 0.f }, { 0.f, 0.f, -1.f }, { 0.f, 1.f, 0.f });
+	scene.vShader.projection = projection(3.14159265f / 3.f, float(kWidth) / kHeight, 0.1f, 50.f);
+	return scene;
+}
+
+// Checkerboard with some noise, so that the mip levels differ
+std::shared_ptr<const Texture> CheckerTexture() {
+
+	constexpr int size = 256;
+	std::mt19937 rng(6);
+	std::uniform_real_distribution<float> noise(0.f, 0.2f);
+	std::vector<Vec3> colors(size * size);
+	for (int y = 0; y < size; ++y) {
+		for (int x = 0; x < size; ++x) {
+			const float c = ((x / 16 + y / 16) % 2 ? 0.8f : 0.1f) + noise(rng);
+			colors[y * size + x] = { c, c * 0.9f, c * 0.7f };
+		}
+	}
+	return std::make_shared<const Texture>(size, size, std::move(colors), TextureFormat::RGBA8);
+}
+
+void PrintScene(const SceneResult& scene) {
+
+	const double pixels = double(kWidth) * kHeight;
+	std::printf("%s: %zu triangles, %zu after setup, %llu fragments (%.2f per pixel)\n", scene.name.c_str(),
+		scene.triangles, scene.setupTriangles, static_cast<unsigned long long>(scene.fragments), scene.fragments / pixels);
+	std::printf("  %-24s %10s %10s %10s %10s %12s\n", "stage", "ms", "Mtri/s", "Mfrag/s", "ns/pixel", "peak KiB");
+	for (const Stage& stage : scene.stages) {
+		std::printf("  %-24s %10.3f %10.2f %10.2f %10.3f %12lld\n", stage.name.c_str(), stage.ms,
+			scene.triangles / stage.ms / 1e3, scene.fragments / stage.ms / 1e3, stage.ms * 1e6 / pixels,
+			static_cast<long long>(stage.peakBytes / 1024));
+	}
+}
+
+bool WriteJson(const char* filename, const std::vector<SceneResult>& scenes, int repetitions) {
+
+	FILE* file = std::fopen(filename, "w");
+	if (!file) {
+		return false;
+	}
+
+	const double pixels = double(kWidth) * kHeight;
+#if defined(RASTERIZER_AVX2)
+	const char* simd = "avx2";
+#elif defined(RASTERIZER_SSE2)
+	const char* simd = "sse2";
+#else
+	const char* simd = "none";
+#endif
+
+	std::fprintf(file, "{\n  \"width\": %d,\n  \"height\": %d,\n  \"threads\": %d,\n  \"simd\": \"%s\",\n  \"repetitions\": %d,\n  \"scenes\": [",
+		kWidth, kHeight, DefaultThreadPool().size(), simd, repetitions);
+	for (size_t i = 0; i < scenes.size(); ++i) {
+		const SceneResult& scene = scenes[i];
+		std::fprintf(file, "%s\n    {\n      \"name\": \"%s\",\n      \"triangles\": %zu,\n      \"setup_triangles\": %zu,\n      \"fragments\": %llu,\n      \"stages\": [",
+			i ? "," : "", scene.name.c_str(), scene.triangles, scene.setupTriangles, static_cast<unsigned long long>(scene.fragments));
+		for (size_t j = 0; j < scene.stages.size(); ++j) {
+			const Stage& stage = scene.stages[j];
+			std::fprintf(file, "%s\n        { \"stage\": \"%s\", \"ms\": %.6g, \"triangles_per_s\": %.6g, \"fragments_per_s\": %.6g, \"ns_per_pixel\": %.6g, \"peak_bytes\": %lld }",
+				j ? "," : "", stage.name.c_str(), stage.ms, scene.triangles / stage.ms * 1e3, scene.fragments / stage.ms * 1e3,
+				stage.ms * 1e6 / pixels, static_cast<long long>(stage.peakBytes));
+		}
+		std::fprintf(file, "\n      ]\n    }");
+	}
+	std::fprintf(file, "\n  ]\n}\n");
+	return std::fclose(file) == 0;
+}
+
+}
+
+int main(int argc, char** argv) {
+
+	const char* sceneFilter = nullptr;
+	const char* jsonFile = nullptr;
+	int repetitions = 3;
+	for (int i = 1; i < argc; ++i) {
+		if (std::strcmp(argv[i], "--scene") == 0 && i + 1 < argc) {
+			sceneFilter = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--repetitions") == 0 && i + 1 < argc) {
+			repetitions = std::max(std::atoi(argv[++i]), 1);
+		}
+		else if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+			jsonFile = argv[++i];
+		}
+		else {
+			std::fprintf(stderr, "usage: %s [--scene name] [--repetitions n] [--json file]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	std::vector<SceneResult> results;
+	const auto run = [&](const char* name, auto&& makeScene, auto&& runScene) {
+		if (!sceneFilter || std::strcmp(sceneFilter, name) == 0) {
+			results.push_back(runScene(makeScene()));
+			PrintScene(results.back());
+		}
+	};
+
+	run("tiny_triangles", TinyTriangles, [&](const Scene& scene) {
+		return RunScene<OpaqueState>(scene, GradientShader(), repetitions);
+		});
+	run("huge_triangles", HugeTriangles, [&](const Scene& scene) {
+		return RunScene<OpaqueState>(scene, GradientShader(), repetitions);
+		});
+	run("alpha_overdraw", AlphaOverdraw, [&](const Scene& scene) {
+		return RunScene<DefaultState>(scene, GradientShader{ 0.25f }, repetitions);
+		});
+	run("texture_minification", TextureMinification, [&](const Scene& scene) {
+		return RunScene<OpaqueState>(scene, TextureFragShader(CheckerTexture()), repetitions);
+		});
+	run("near_plane", NearPlane, [&](const Scene& scene) {
+		return RunScene<OpaqueState>(scene, GradientShader(), repetitions);
+		});
+
+	if (results.empty()) {
+		std::fprintf(stderr, "unknown scene %s\n", sceneFilter);
+		return 1;
+	}
+	if (jsonFile && !WriteJson(jsonFile, results, repetitions)) {
+		std::fprintf(stderr, "can't write %s\n", jsonFile);
+		return 1;
+	}
+	return 0;
+}
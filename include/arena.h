@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "threadpool.h"
+
+// Frame allocator for the transient data of the draws: shaded vertices, set up triangles, bins,
+// fragments. Memory is taken from large blocks by bumping a pointer and is never freed on its
+// own: everything goes at once with reset(), typically at the start of each frame, and the blocks
+// are kept for the next frame. Once the arenas are large enough for a frame, drawing makes no
+// heap allocations.
+
+constexpr size_t kArenaBlockSize = size_t(1) << 20;
+constexpr size_t kArenaAlignment = 64;	// Of the blocks
+
+// Bump allocator, used by one thread at a time
+class alignas(64) Arena {	// Arenas of different threads don't share cache lines
+
+public:
+
+	explicit Arena(size_t blockSize_ = kArenaBlockSize) : blockSize(blockSize_) {}
+
+	// align is a power of two
+	void* allocate(size_t size, size_t align) {
+		if (current < blocks.size()) {
+			const uintptr_t base = reinterpret_cast<uintptr_t>(blocks[current].data.get());
+			const uintptr_t start = (base + offset + align - 1) & ~uintptr_t(align - 1);
+			if (start + size <= base + blocks[current].size) {
+				offset = start + size - base;
+				return reinterpret_cast<void*>(start);
+			}
+		}
+		return allocateBlock(size, align);
+	}
+
+	// Free everything allocated so far. If the allocations took several blocks, they are replaced
+	// by a single one as large as all of them, so that the next frame makes no allocation.
+	void reset();
+
+	// Bytes allocated since the last reset, alignment included
+	size_t used() const {
+		return usedBefore + offset;
+	}
+
+	// Bytes of the blocks
+	size_t capacity() const;
+
+private:
+
+	struct BlockDeleter {
+		void operator()(std::byte* data) const {
+			::operator delete[](data, std::align_val_t(kArenaAlignment));
+		}
+	};
+
+	struct Block {
+		std::unique_ptr<std::byte[], BlockDeleter> data;
+		size_t size;
+	};
+
+	void* allocateBlock(size_t size, size_t align);
+
+	size_t blockSize;
+	std::vector<Block> blocks;
+	size_t current = 0;			// Block allocated from, the last one
+	size_t offset = 0;			// In the current block
+	size_t usedBefore = 0;		// In the previous blocks
+
+};
+
+// Standard allocator taking its memory from an arena, or from the heap if the arena is null, so
+// that containers of the pipeline work with and without one. Memory is only given back to the
+// arena by its reset(): a growing vector leaves its previous buffers behind.
+template <typename T>
+struct ArenaAllocator {
+
+	using value_type = T;
+	using propagate_on_container_move_assignment = std::true_type;
+	using propagate_on_container_swap = std::true_type;
+
+	Arena* arena = nullptr;
+
+	ArenaAllocator() = default;
+
+	explicit ArenaAllocator(Arena* arena_) : arena(arena_) {}
+
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+	T* allocate(size_t n) {
+		if (arena) {
+			return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+		}
+		return std::allocator<T>().allocate(n);
+	}
+
+	void deallocate(T* ptr, size_t n) {
+		if (!arena) {
+			std::allocator<T>().deallocate(ptr, n);
+		}
+	}
+
+	template <typename U>
+	bool operator==(const ArenaAllocator<U>& other) const {
+		return arena == other.arena;
+	}
+
+};
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+// One arena per worker of a thread pool, so that the parallel stages of the draws allocate without
+// locks. Give it to the draws in DrawOptions::arena and reset it once per frame, when no draw is
+// running; everything the draws allocated from it is then gone.
+class FrameArena {
+
+public:
+
+	explicit FrameArena(const ThreadPool& pool = DefaultThreadPool(), size_t blockSize = kArenaBlockSize) {
+		for (int i = 0; i < pool.size(); ++i) {
+			arenas.emplace_back(blockSize);
+		}
+	}
+
+	// Arena of the calling thread, see ThreadPool::currentWorker. Threads outside the pool share
+	// the arena of worker 0, so only one of them may draw with the frame arena at a time.
+	Arena& local();
+
+	// Number of arenas, one per worker of the pool it was made for
+	int size() const {
+		return static_cast<int>(arenas.size());
+	}
+
+	void reset() {
+		for (Arena& arena : arenas) {
+			arena.reset();
+		}
+	}
+
+	// Bytes allocated since the last reset by all the workers
+	size_t used() const;
+
+	size_t capacity() const;
+
+private:
+
+	std::vector<Arena> arenas;
+
+};
@@ -0,0 +1,238 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <ranges>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "vec.h"
+#include "arena.h"
+#include "raster.h"
+#include "stats.h"
+
+// Primitive assembly: triangles are clipped in homogeneous clip space, before the perspective
+// divide. Triangles entirely outside the view frustum are rejected, and the others are only clipped
+// against the near and far planes and against a guard band: a region much larger than the screen,
+// sized so that window coordinates stay in the range of the fixed point rasterizer. Triangles
+// crossing the screen borders but inside the guard band (almost all of them) are not clipped, the
+// rasterizer just skips the pixels out of the screen.
+
+enum ClipPlane : uint32_t {
+	kClipNear = 1 << 0,		// z >= -w
+	kClipFar = 1 << 1,		// z <= w
+	kClipLeft = 1 << 2,		// x >= -g * w
+	kClipRight = 1 << 3,	// x <= g * w
+	kClipBottom = 1 << 4,	// y >= -g * w
+	kClipTop = 1 << 5,		// y <= g * w
+};
+
+constexpr int kClipPlanes = 6;
+
+enum class CullMode {
+	None,
+	Back,	// Cull the triangles facing away from the viewer
+	Front,
+};
+
+// Winding of the vertices of front facing triangles, as seen on the screen
+enum class FrontFace {
+	CounterClockwise,
+	Clockwise,
+};
+
+// True if the triangle faces the culled side
+inline bool IsCulled(const Triangle& tri, CullMode cull, FrontFace frontFace) {
+	if (cull == CullMode::None) {
+		return false;
+	}
+	const bool front = tri.counterClockwise == (frontFace == FrontFace::CounterClockwise);
+	return front == (cull == CullMode::Front);
+}
+
+// Planes of the clip volume, where g is 1 for the view frustum or the size of the guard band
+struct ClipVolume {
+
+	float gx = 1.f;
+	float gy = 1.f;
+
+	// Signed distance to the plane, scaled by some positive factor: >= 0 inside
+	float distance(const Vec4& p, int plane) const {
+		switch (plane) {
+		case 0: return p.z + p.w;
+		case 1: return p.w - p.z;
+		case 2: return p.x + gx * p.w;
+		case 3: return gx * p.w - p.x;
+		case 4: return p.y + gy * p.w;
+		case 5:
+		default: return gy * p.w - p.y;
+		}
+	}
+
+	// Bit i is set if the point is outside plane i
+	uint32_t outcode(const Vec4& p) const {
+		uint32_t res = 0;
+		for (int plane = 0; plane < kClipPlanes; ++plane) {
+			res |= distance(p, plane) < 0.f ? 1u << plane : 0u;
+		}
+		return res;
+	}
+
+};
+
+// Guard band of a w x h framebuffer, in NDC units. Never smaller than the screen, so larger
+// framebuffers than the fixed point range fall back to the float rasterizer.
+inline ClipVolume GuardBand(int w, int h) {
+	// Window coordinates in [-kMaxFixedCoord, kMaxFixedCoord], with a margin for rounding
+	constexpr float maxCoord = kMaxFixedCoord - kBlockSize;
+	return { std::max(2.f * maxCoord / w - 1.f, 1.f), std::max(2.f * maxCoord / h - 1.f, 1.f) };
+}
+
+// Vertex at t along the segment from a to b, attributes included
+template <typename Vert>
+Vert LerpVertex(const Vert& a, const Vert& b, float t) {
+
+	Vert res = a;
+	res.pos = a.pos * (1.f - t) + b.pos * t;
+	[&]<size_t... I>(std::index_sequence<I...>) {
+		((std::get<I>(res.attr) = std::get<I>(a.attr) * (1.f - t) + std::get<I>(b.attr) * t), ...);
+	}(std::make_index_sequence<std::tuple_size_v<decltype(a.attr)>>{});
+	return res;
+}
+
+// Clip the triangle against the planes in mask. The vertices of the clipped polygon are appended
+// to verts, and the triangles of its fan are passed to emit(ia, ib, ic).
+template <typename Vert, typename Alloc, typename Emit>
+void ClipTriangle(std::vector<Vert, Alloc>& verts, uint32_t ia, uint32_t ib, uint32_t ic, const ClipVolume& volume, uint32_t mask, Emit&& emit) {
+
+	// Each plane adds at most one vertex
+	constexpr int maxVerts = 3 + kClipPlanes;
+	uint32_t polygon[maxVerts] = { ia, ib, ic };
+	uint32_t clipped[maxVerts];
+	int count = 3;
+
+	for (int plane = 0; plane < kClipPlanes && count >= 3; ++plane) {
+		if (!(mask & (1u << plane))) {
+			continue;
+		}
+
+		int clippedCount = 0;
+		for (int i = 0; i < count; ++i) {
+			const uint32_t cur = polygon[i];
+			const uint32_t next = polygon[(i + 1) % count];
+			const float dCur = volume.distance(verts[cur].pos, plane);
+			const float dNext = volume.distance(verts[next].pos, plane);
+
+			if (dCur >= 0.f) {
+				clipped[clippedCount++] = cur;
+			}
+			if ((dCur >= 0.f) != (dNext >= 0.f)) {
+				// Always interpolated from the inside vertex, so that the edge shared by two
+				// triangles is cut at the same point for both
+				const Vert split = dCur >= 0.f ?
+					LerpVertex(verts[cur], verts[next], dCur / (dCur - dNext)) :
+					LerpVertex(verts[next], verts[cur], dNext / (dNext - dCur));
+				clipped[clippedCount++] = static_cast<uint32_t>(verts.size());
+				verts.push_back(split);
+			}
+		}
+
+		std::copy(clipped, clipped + clippedCount, polygon);
+		count = clippedCount;
+	}
+
+	for (int i = 1; i + 1 < count; ++i) {
+		emit(polygon[0], polygon[i], polygon[i + 1]);
+	}
+}
+
+// Clip the triangles given by consecutive triples of indices into verts (in clip space), divide the
+// vertices by w (pos.w becomes 1/w) and set up the triangles for rasterization. Vertices made by
+// clipping are appended to verts. Culled triangles, and triangles covering no pixel center (zero
+// area or too small) are dropped, or covering no sample for multisampled framebuffers. The triangle
+// counters of stats are updated if given. The triangles and the scratch memory are taken from arena,
+// or from the heap if it is null.
+template <int samples = 1, typename Vert, typename Alloc, typename Indices>
+ArenaVector<Triangle> AssembleTriangles(std::vector<Vert, Alloc>& verts, const Indices& indices, int w, int h,
+	CullMode cull = CullMode::None, FrontFace frontFace = FrontFace::CounterClockwise, DrawStats* stats = nullptr,
+	Arena* arena = nullptr) {
+
+	const ClipVolume frustum;
+	const ClipVolume guardBand = GuardBand(w, h);
+
+	const size_t inputVerts = verts.size();
+	ArenaVector<uint8_t> frustumCodes(inputVerts, ArenaAllocator<uint8_t>(arena));
+	ArenaVector<uint8_t> clipCodes(inputVerts, ArenaAllocator<uint8_t>(arena));
+	for (size_t i = 0; i < inputVerts; ++i) {
+		frustumCodes[i] = static_cast<uint8_t>(frustum.outcode(verts[i].pos));
+		clipCodes[i] = static_cast<uint8_t>(guardBand.outcode(verts[i].pos));
+	}
+
+	// Triples of indices of the visible triangles, clipped or not
+	ArenaVector<uint32_t> kept{ ArenaAllocator<uint32_t>(arena) };
+	const size_t count = std::ranges::size(indices) / 3 * 3;
+	kept.reserve(count);
+	uint64_t outside = 0;
+	uint64_t clipped = 0;
+
+	for (size_t i = 0; i < count; i += 3) {
+		const uint32_t ia = indices[i];
+		const uint32_t ib = indices[i + 1];
+		const uint32_t ic = indices[i + 2];
+
+		// All the vertices outside the same plane of the frustum
+		if (frustumCodes[ia] & frustumCodes[ib] & frustumCodes[ic]) {
+			++outside;
+			continue;
+		}
+
+		const uint32_t mask = clipCodes[ia] | clipCodes[ib] | clipCodes[ic];
+		if (mask == 0) {
+			kept.insert(kept.end(), { ia, ib, ic });
+		}
+		else {
+			++clipped;
+			ClipTriangle(verts, ia, ib, ic, guardBand, mask, [&](uint32_t a, uint32_t b, uint32_t c) {
+				kept.insert(kept.end(), { a, b, c });
+				});
+		}
+	}
+
+	// Perspective divide, keeping 1/w in pos.w for perspective correct interpolation. Vertices with
+	// w <= 0 are outside the near plane, so only clipped triangles used them.
+	for (Vert& vert : verts) {
+		if (vert.pos.w > 0.f) {
+			const float invW = 1.f / vert.pos.w;
+			vert.pos = vert.pos / vert.pos.w;
+			vert.pos.w = invW;
+		}
+	}
+
+	ArenaVector<Triangle> triangles{ ArenaAllocator<Triangle>(arena) };
+	triangles.reserve(kept.size() / 3);
+	uint64_t empty = 0;
+	uint64_t culled = 0;
+	for (size_t i = 0; i < kept.size(); i += 3) {
+		const Triangle tri = SetupTriangle<samples>(std::span<const Vert>(verts), kept[i], kept[i + 1], kept[i + 2], w, h);
+		if (tri.empty()) {
+			++empty;
+		}
+		else if (IsCulled(tri, cull, frontFace)) {
+			++culled;
+		}
+		else {
+			triangles.push_back(tri);
+		}
+	}
+
+	if (stats) {
+		stats->trianglesSubmitted += count / 3;
+		stats->trianglesOutside += outside;
+		stats->trianglesClipped += clipped;
+		stats->trianglesCulled += culled;
+		stats->trianglesEmpty += empty;
+		stats->trianglesRasterized += triangles.size();
+	}
+	return triangles;
+}
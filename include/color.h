@@ -0,0 +1,95 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+#include "vec.h"
+#include "simd.h"
+
+// Conversions between linear colors and gamma encoded values, without calling pow per value.
+//
+// Decoding (encoded value to linear) uses exact tables, one entry per possible input value.
+// Encoding (linear to encoded) uses a table of 32 linear segments per power of two of the input,
+// over [2^-20, 1], and a single linear segment below. The max absolute error of fromLinear() over
+// [0, 1] is below 2.5e-5 for the sRGB curve, and below 6e-4 for v^(1/2.2), where the error is
+// near 0 (the curve has an infinite slope there). fromLinear8() differs from the correctly
+// rounded result only for values within 0.6% of an LSB from the middle of two codes, about one
+// input in 15000.
+class ColorCurve {
+
+public:
+
+	// Power curve: linear = encoded^gamma
+	static ColorCurve Gamma(float gamma);
+
+	// Standard sRGB transfer function
+	static ColorCurve SRGB();
+
+	// Linear value of an 8 bit encoded channel
+	float toLinear8(uint8_t v) const {
+		return decode8[v];
+	}
+
+	// Linear values of all the encoded values in [0, maxValue], e.g. for 16 bit images
+	std::vector<float> toLinearTable(int maxValue) const;
+
+	float fromLinear(float v) const {
+
+		// Negative values and NaN encode to 0, as in the SSE2 path; a NaN would index past the table
+		if (!(v > 0.f)) {
+			return 0.f;
+		}
+		v = std::min(v, 1.f);
+		if (v < kMinSegmented) {
+			return v * lowSlope;
+		}
+
+		const uint32_t bits = std::bit_cast<uint32_t>(v) - kMinSegmentedBits;
+		const uint32_t segment = bits >> kFractionBits;
+		const float t = static_cast<float>(bits & kFractionMask) * (1.f / (1 << kFractionBits));
+		return encodeStart[segment] + encodeSlope[segment] * t;
+	}
+
+	uint8_t fromLinear8(float v) const {
+		return static_cast<uint8_t>(fromLinear(v) * 255.f + 0.5f);
+	}
+
+	Vec3 fromLinear(const Vec3& color) const {
+		return { fromLinear(color.r), fromLinear(color.g), fromLinear(color.b) };
+	}
+
+	// Encode n values to 8 bits, 4 at a time with SSE2
+	void fromLinear8(const float* in, int n, uint8_t* out) const;
+
+private:
+
+	static constexpr int kOctaves = 20;
+	static constexpr int kSegmentBits = 5;
+	static constexpr int kFractionBits = 23 - kSegmentBits;
+	static constexpr uint32_t kFractionMask = (1u << kFractionBits) - 1;
+	static constexpr float kMinSegmented = 1.f / (1 << kOctaves);
+	static constexpr uint32_t kMinSegmentedBits = uint32_t(127 - kOctaves) << 23;
+	static constexpr int kSegments = kOctaves << kSegmentBits;
+
+	using CurveFn = float (*)(float v, float param);
+
+	ColorCurve(CurveFn toLinearFn, CurveFn fromLinearFn, float param);
+
+	std::array<float, 256> decode8;
+
+	// The last segment starts at 1, for inputs clamped to 1
+	std::array<float, kSegments + 1> encodeStart;
+	std::array<float, kSegments + 1> encodeSlope;
+	float lowSlope;
+
+	CurveFn toLinearFn;
+	float param;
+
+};
+
+// Curves shared by the whole program, built on first use
+const ColorCurve& SRGBCurve();
+const ColorCurve& GammaCurve(float gamma);
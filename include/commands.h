@@ -0,0 +1,366 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <typeindex>
+#include <typeinfo>
+#include <vector>
+
+#include "pipeline.h"
+
+// Order-independent draws are sorted by depth in this many buckets, then by pipeline
+constexpr int kSortDepthBuckets = 1024;
+
+// Draws recorded with their own vertices, shaders and pipeline state, then submitted together.
+//
+// Submission shades the vertices and sets up the triangles of all the draws first, small draws in
+// parallel with each other. Draws are then reordered for the early depth test: runs of
+// order-independent draws (see OrderIndependent) are drawn front to back, and by pipeline at similar
+// depths, but no draw is moved across one that depends on the order, e.g. a blended one. The result
+// is the same as drawing them one by one, up to fragments at equal depths. In the binned mode the
+// triangles of all the draws are binned together and the tiles are rendered in a single parallel
+// pass, instead of one per draw; the other modes render the draws one after the other.
+//
+// Vertices and indices are read by submit(), so they must outlive it. Scratch memory (binned
+// triangles, the buffers of the draws) is kept across submissions.
+template <typename FB>
+class CommandList {
+
+public:
+
+	// Record a draw of triangles made of three consecutive vertices, see DrawTriangles
+	template <typename State = DefaultState, typename VertAttr, typename Vert, typename Frag>
+	void draw(std::span<VertAttr> vertices, Vert vShader, Frag fShader) {
+		record<DrawCommand<State, VertAttr, Vert, Frag>>().set(vertices, {}, false, std::move(vShader), std::move(fShader));
+	}
+
+	// Record a draw of triangles made of three consecutive indices into the vertices, see
+	// DrawIndexedTriangles
+	template <typename State = DefaultState, typename VertAttr, typename Vert, typename Frag>
+	void drawIndexed(std::span<VertAttr> vertices, std::span<const uint32_t> indices, Vert vShader, Frag fShader) {
+		// Checked now, since vertices are shaded on worker threads
+		if (std::ranges::any_of(indices, [&](uint32_t index) { return index >= vertices.size(); })) {
+			throw std::out_of_range("CommandList::drawIndexed: vertex index out of range");
+		}
+		record<DrawCommand<State, VertAttr, Vert, Frag>>().set(vertices, indices, true, std::move(vShader), std::move(fShader));
+	}
+
+	size_t size() const {
+		return count;
+	}
+
+	// Remove the recorded draws. Their buffers are kept for the draws recorded next, when they are
+	// recorded in the same order with the same types, as a list recorded every frame usually is.
+	void clear() {
+		count = 0;
+	}
+
+	// Draw the recorded draws. With Instrumented states, the statistics of those draws are returned.
+	DrawStats submit(FB& framebuffer, const DrawOptions& options = {});
+
+private:
+
+	struct BinEntry {
+		uint32_t command;
+		uint32_t triangle;
+	};
+
+	struct Command {
+
+		ArenaVector<Triangle> triangles;
+		DrawStats stats;		// Only for instrumented draws
+		float depth = 0.f;		// Nearest depth of the triangles
+
+		virtual ~Command() = default;
+
+		virtual bool orderIndependent() const = 0;
+		virtual bool instrumented() const = 0;
+		virtual size_t vertexCount() const = 0;
+
+		// Draws with the same pipeline run the same code
+		virtual std::type_index pipeline() const = 0;
+
+		virtual void shadeVertices(const DrawOptions& options) = 0;
+		virtual void assemble(int w, int h, int workers, const DrawOptions& options) = 0;
+
+		// Whole draw in the mode of the options
+		virtual void execute(FB& framebuffer, const DrawOptions& options, DrawStats& stats) = 0;
+
+		// Triangles of the binned entries inside the rectangle [x0, x1) x [y0, y1)
+		virtual void executeTile(FB& framebuffer, int x0, int y0, int x1, int y1, std::span<const BinEntry> entries,
+			int worker, const DrawOptions& options, DrawStats& stats) = 0;
+
+	};
+
+	template <typename State, typename VertAttr, typename Vert, typename Frag>
+	struct DrawCommand : Command {
+
+		using VertOut = decltype(ShadeVertex(std::declval<Vert&>(), std::declval<VertAttr&>()));
+
+		std::span<VertAttr> vertices;
+		std::span<const uint32_t> indices;
+		bool indexed = false;
+		std::optional<Vert> vShader;	// Shaders may not be assignable
+		std::optional<Frag> fShader;
+
+		std::vector<VertOut> verts;
+		std::vector<uint32_t> shadedIndices;
+		std::vector<Frag> shaders;	// One per worker, shaders are not required to be thread safe
+
+		void set(std::span<VertAttr> vertices_, std::span<const uint32_t> indices_, bool indexed_, Vert vShader_, Frag fShader_) {
+			vertices = vertices_;
+			indices = indices_;
+			indexed = indexed_;
+			vShader.emplace(std::move(vShader_));
+			fShader.emplace(std::move(fShader_));
+		}
+
+		bool orderIndependent() const override {
+			return OrderIndependent<State>();
+		}
+
+		bool instrumented() const override {
+			return IsInstrumented<State>();
+		}
+
+		size_t vertexCount() const override {
+			return vertices.size();
+		}
+
+		std::type_index pipeline() const override {
+			return typeid(DrawCommand);
+		}
+
+		void shadeVertices(const DrawOptions& options) override {
+			this->stats = {};
+			if (indexed) {
+				ShadeIndexedVertices(*vShader, vertices, indices, verts, shadedIndices, options);
+			}
+			else {
+				verts.resize(vertices.size());
+				ShadeVertices(*vShader, std::span<const VertAttr>(vertices), std::span<VertOut>(verts), options);
+			}
+			if constexpr (IsInstrumented<State>()) {
+				this->stats.verticesShaded = verts.size();
+			}
+		}
+
+		void assemble(int w, int h, int workers, const DrawOptions& options) override {
+			DrawStats* stats = IsInstrumented<State>() ? &this->stats : nullptr;
+			Arena* arena = LocalArena(options);
+			if (indexed) {
+				this->triangles = AssembleTriangles<FB::samples>(verts, shadedIndices, w, h, DrawCullMode<State>(options), options.frontFace,
+					stats, arena);
+			}
+			else {
+				this->triangles = AssembleTriangles<FB::samples>(verts, std::views::iota(uint32_t(0), static_cast<uint32_t>(vertices.size())),
+					w, h, DrawCullMode<State>(options), options.frontFace, stats, arena);
+			}
+
+			this->depth = std::numeric_limits<float>::max();
+			for (const Triangle& tri : this->triangles) {
+				this->depth = std::min(this->depth, tri.zMin);
+			}
+			shaders.clear();
+			for (int i = 0; i < workers; ++i) {
+				shaders.push_back(*fShader);
+			}
+		}
+
+		void execute(FB& framebuffer, const DrawOptions& options, DrawStats& stats) override {
+			DrawAssembled<State>(framebuffer, std::span<const VertOut>(verts), std::span<const Triangle>(this->triangles), shaders[0], options, stats);
+		}
+
+		void executeTile(FB& framebuffer, int x0, int y0, int x1, int y1, std::span<const BinEntry> entries,
+			int worker, const DrawOptions& options, DrawStats& stats) override {
+
+			CountersOf<State> counters;
+			counters.overdraw = options.overdraw;
+			for (const BinEntry& entry : entries) {
+				DrawTriangleStreaming<State>(framebuffer, shaders[worker], std::span<const VertOut>(verts), this->triangles[entry.triangle],
+					x0, y0, x1, y1, counters);
+			}
+			stats.add(counters);
+		}
+
+	};
+
+	// The first count are recorded, the others are kept for their buffers
+	std::vector<std::unique_ptr<Command>> commands;
+	size_t count = 0;
+
+	// Scratch memory, kept across submissions
+	std::vector<uint32_t> order;
+	std::vector<uint32_t> smallCommands;
+	std::vector<std::vector<BinEntry>> bins;
+	std::vector<DrawStats> workerStats;
+
+	void sortCommands();
+
+	// Next command, reusing the one previously at this place if it has the same type
+	template <typename Cmd>
+	Cmd& record() {
+		if (count == commands.size()) {
+			commands.push_back(std::make_unique<Cmd>());
+		}
+		else if (typeid(*commands[count]) != typeid(Cmd)) {
+			commands[count] = std::make_unique<Cmd>();
+		}
+		return static_cast<Cmd&>(*commands[count++]);
+	}
+
+};
+
+// Order of execution: runs of order-independent draws are sorted, the others stay where they are
+template <typename FB>
+void CommandList<FB>::sortCommands() {
+
+	const auto key = [&](uint32_t c) {
+		const float depth = std::clamp(commands[c]->depth, 0.f, 1.f);
+		return static_cast<int>(depth * (kSortDepthBuckets - 1));
+	};
+	const auto sortRun = [&](size_t start) {
+		std::sort(order.begin() + start, order.end(), [&](uint32_t a, uint32_t b) {
+			const int keyA = key(a);
+			const int keyB = key(b);
+			if (keyA != keyB) {
+				return keyA < keyB;
+			}
+			const std::type_index pipelineA = commands[a]->pipeline();
+			const std::type_index pipelineB = commands[b]->pipeline();
+			if (pipelineA != pipelineB) {
+				return pipelineA < pipelineB;
+			}
+			return a < b;
+			});
+	};
+
+	order.clear();
+	size_t runStart = 0;
+	for (uint32_t c = 0; c < count; ++c) {
+		if (commands[c]->triangles.empty()) {
+			continue;
+		}
+		if (!commands[c]->orderIndependent()) {
+			sortRun(runStart);
+			order.push_back(c);
+			runStart = order.size();
+		}
+		else {
+			order.push_back(c);
+		}
+	}
+	sortRun(runStart);
+}
+
+template <typename FB>
+DrawStats CommandList<FB>::submit(FB& framebuffer, const DrawOptions& options) {
+
+	CheckDrawArena(options);
+	DrawStats stats;
+	StageTimer<true> timer;
+	StageTimer<true> total;
+	const bool instrumented = std::any_of(commands.begin(), commands.begin() + count, [](const auto& command) { return command->instrumented(); });
+
+	ThreadPool& pool = options.pool ? *options.pool : DefaultThreadPool();
+	const int workers = DrawWorkers(pool, options);
+
+	// Vertex processing. Small draws are shaded in parallel with each other, large ones one after the
+	// other, each in parallel batches.
+	smallCommands.clear();
+	for (uint32_t c = 0; c < count; ++c) {
+		if (commands[c]->vertexCount() <= kVertexBatch) {
+			smallCommands.push_back(c);
+		}
+		else {
+			commands[c]->shadeVertices(options);
+		}
+	}
+	pool.parallelFor(static_cast<int>(smallCommands.size()), [&](int i, int) {
+		commands[smallCommands[i]]->shadeVertices(options);
+		}, workers);
+	stats.vertexMs = timer.lap();
+
+	// Primitive assembly
+	pool.parallelFor(static_cast<int>(count), [&](int c, int) {
+		commands[c]->assemble(framebuffer.w, framebuffer.h, workers, options);
+		}, workers);
+	stats.setupMs = timer.lap();
+
+	sortCommands();
+
+	workerStats.assign(workers, DrawStats{});
+
+	if (options.mode == RasterMode::Binned) {
+
+		// The triangles of all the draws, in order of execution
+		const int tileSize = BinTileSize(options.tileSize);
+		const int tilesX = (framebuffer.w + tileSize - 1) / tileSize;
+		const int tilesY = (framebuffer.h + tileSize - 1) / tileSize;
+		bins.resize(tilesX * tilesY);
+		for (auto& bin : bins) {
+			bin.clear();
+		}
+		for (uint32_t c : order) {
+			const ArenaVector<Triangle>& triangles = commands[c]->triangles;
+			for (uint32_t i = 0; i < triangles.size(); ++i) {
+				const Triangle& tri = triangles[i];
+				for (int ty = tri.bottom / tileSize; ty <= (tri.top - 1) / tileSize; ++ty) {
+					for (int tx = tri.left / tileSize; tx <= (tri.right - 1) / tileSize; ++tx) {
+						bins[ty * tilesX + tx].push_back({ c, i });
+					}
+				}
+			}
+		}
+		stats.binningMs = timer.lap();
+
+		pool.parallelFor(tilesX * tilesY, [&](int tile, int worker) {
+
+			const std::vector<BinEntry>& bin = bins[tile];
+			const int x0 = (tile % tilesX) * tileSize;
+			const int y0 = (tile / tilesX) * tileSize;
+			const int x1 = std::min(x0 + tileSize, framebuffer.w);
+			const int y1 = std::min(y0 + tileSize, framebuffer.h);
+
+			// Consecutive triangles of the same draw at once
+			for (size_t start = 0; start < bin.size();) {
+				size_t end = start + 1;
+				while (end < bin.size() && bin[end].command == bin[start].command) {
+					++end;
+				}
+				commands[bin[start].command]->executeTile(framebuffer, x0, y0, x1, y1,
+					std::span<const BinEntry>(bin.data() + start, end - start), worker, options, workerStats[worker]);
+				start = end;
+			}
+			}, workers);
+		stats.rasterMs = timer.lap();
+	}
+	else {
+		// Stages timed by each draw
+		for (uint32_t c : order) {
+			DrawStats drawStats;
+			commands[c]->execute(framebuffer, options, drawStats);
+			if (instrumented) {
+				workerStats[0].add(drawStats);
+			}
+		}
+	}
+
+	if (!instrumented) {
+		return {};
+	}
+	for (size_t c = 0; c < count; ++c) {
+		stats.add(commands[c]->stats);
+	}
+	for (const DrawStats& workerStat : workerStats) {
+		stats.add(workerStat);
+	}
+	stats.pixels = framebuffer.w * framebuffer.h;
+	stats.totalMs = total.lap();
+	return stats;
+}
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include "vec.h"
+#include "simd.h"
+#include "color.h"
+
+// Storage formats of the framebuffer. Each format declares the type stored per pixel and how to
+// convert it from and to the values used by the pipeline. Conversions happen when a fragment is
+// written, so everything before the write stage works with floats.
+//
+// Formats made of 8 bit RGBA channels declare bytesRGBA8 = true, so that they can be written
+// to image files as they are.
+
+// Round and clamp color channels to [0, 2^bits - 1], NaN to 0
+template <int bits>
+uint32_t QuantizeUnorm(float v) {
+	if (!(v > 0.f)) {
+		return 0;
+	}
+	if constexpr (bits > 16) {
+		// Rounded in double, floats can't hold every value up to 2^24 and 1 would give 2^bits
+		constexpr double maxValue = static_cast<double>((1u << bits) - 1);
+		return static_cast<uint32_t>(std::min(static_cast<double>(v), 1.) * maxValue + 0.5);
+	}
+	else {
+		constexpr float maxValue = static_cast<float>((1u << bits) - 1);
+		return static_cast<uint32_t>(std::min(v, 1.f) * maxValue + 0.5f);
+	}
+}
+
+template <int bits>
+float UnquantizeUnorm(uint32_t v) {
+	constexpr float scale = 1.f / static_cast<float>((1u << bits) - 1);
+	return static_cast<float>(v) * scale;
+}
+
+
+// 32 bit float per channel, no conversion at all
+struct ColorRGBA32F {
+	using Storage = Vec4;
+
+	static Storage encode(const Vec4& color) {
+		return color;
+	}
+
+	static Vec4 decode(const Storage& value) {
+		return value;
+	}
+};
+
+// 8 bit unsigned normalized channels, stored as they are
+struct ColorRGBA8 {
+	using Storage = std::array<uint8_t, 4>;
+	static constexpr bool bytesRGBA8 = true;
+
+	static Storage encode(const Vec4& color) {
+		Storage res;
+#if defined(RASTERIZER_SSE2)
+		const __m128 clamped = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(&color[0]), _mm_setzero_ps()), _mm_set1_ps(1.f));
+		const __m128i ints = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(clamped, _mm_set1_ps(255.f)), _mm_set1_ps(0.5f)));
+		const __m128i shorts = _mm_packs_epi32(ints, ints);
+		const int bytes = _mm_cvtsi128_si32(_mm_packus_epi16(shorts, shorts));
+		std::memcpy(res.data(), &bytes, 4);
+#else
+		for (int i = 0; i < 4; ++i) {
+			res[i] = static_cast<uint8_t>(QuantizeUnorm<8>(color[i]));
+		}
+#endif
+		return res;
+	}
+
+	static Vec4 decode(const Storage& value) {
+		return { UnquantizeUnorm<8>(value[0]), UnquantizeUnorm<8>(value[1]), UnquantizeUnorm<8>(value[2]), UnquantizeUnorm<8>(value[3]) };
+	}
+};
+
+// 8 bit channels, color encoded with the sRGB transfer function and linear alpha. Blending
+// still happens in linear space.
+struct ColorSRGBA8 {
+	using Storage = std::array<uint8_t, 4>;
+	static constexpr bool bytesRGBA8 = true;
+
+	static Storage encode(const Vec4& color) {
+		const ColorCurve& curve = SRGBCurve();
+		return { curve.fromLinear8(color.r), curve.fromLinear8(color.g), curve.fromLinear8(color.b), static_cast<uint8_t>(QuantizeUnorm<8>(color.a)) };
+	}
+
+	static Vec4 decode(const Storage& value) {
+		const ColorCurve& curve = SRGBCurve();
+		return { curve.toLinear8(value[0]), curve.toLinear8(value[1]), curve.toLinear8(value[2]), UnquantizeUnorm<8>(value[3]) };
+	}
+};
+
+// 10 bit color channels and 2 bit alpha packed in 32 bits, red in the lowest bits
+struct ColorRGB10A2 {
+	using Storage = uint32_t;
+
+	static Storage encode(const Vec4& color) {
+		return QuantizeUnorm<10>(color.r) | QuantizeUnorm<10>(color.g) << 10 | QuantizeUnorm<10>(color.b) << 20 | QuantizeUnorm<2>(color.a) << 30;
+	}
+
+	static Vec4 decode(Storage value) {
+		return { UnquantizeUnorm<10>(value & 0x3ff), UnquantizeUnorm<10>((value >> 10) & 0x3ff),
+			UnquantizeUnorm<10>((value >> 20) & 0x3ff), UnquantizeUnorm<2>(value >> 30) };
+	}
+};
+
+// IEEE 754 half precision conversions, rounding to nearest even
+inline uint16_t FloatToHalf(float f) {
+	uint32_t x;
+	std::memcpy(&x, &f, 4);
+	const uint32_t sign = (x >> 16) & 0x8000;
+	const uint32_t absx = x & 0x7fffffff;
+
+	if (absx >= 0x7f800000) {
+		// Inf or NaN
+		return static_cast<uint16_t>(sign | 0x7c00 | (absx > 0x7f800000 ? 0x200 : 0));
+	}
+	if (absx >= 0x477ff000) {
+		// Rounds to a value too large for a half
+		return static_cast<uint16_t>(sign | 0x7c00);
+	}
+	if (absx < 0x38800000) {
+		// Denormal half: let the float unit do the rounding
+		float af;
+		std::memcpy(&af, &absx, 4);
+		return static_cast<uint16_t>(sign | static_cast<uint32_t>(std::nearbyint(af * 16777216.f)));
+	}
+	const uint32_t rounded = absx + 0xfff + ((absx >> 13) & 1);
+	return static_cast<uint16_t>(sign | ((rounded - 0x38000000) >> 13));
+}
+
+inline float HalfToFloat(uint16_t h) {
+	const uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+	const uint32_t exponent = (h >> 10) & 0x1f;
+	const uint32_t mantissa = h & 0x3ff;
+
+	float res;
+	if (exponent == 0) {
+		res = static_cast<float>(mantissa) * (1.f / 16777216.f);
+		return sign ? -res : res;
+	}
+	const uint32_t x = sign | (exponent == 31 ? 0x7f800000 | mantissa << 13 : (exponent + 112) << 23 | mantissa << 13);
+	std::memcpy(&res, &x, 4);
+	return res;
+}
+
+// 16 bit float per channel
+struct ColorRGBA16F {
+	using Storage = std::array<uint16_t, 4>;
+
+	static Storage encode(const Vec4& color) {
+		Storage res;
+#if defined(RASTERIZER_F16C)
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(res.data()), _mm_cvtps_ph(_mm_loadu_ps(&color[0]), _MM_FROUND_TO_NEAREST_INT));
+#else
+		for (int i = 0; i < 4; ++i) {
+			res[i] = FloatToHalf(color[i]);
+		}
+#endif
+		return res;
+	}
+
+	static Vec4 decode(const Storage& value) {
+		Vec4 res;
+#if defined(RASTERIZER_F16C)
+		_mm_storeu_ps(&res[0], _mm_cvtph_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(value.data()))));
+#else
+		for (int i = 0; i < 4; ++i) {
+			res[i] = HalfToFloat(value[i]);
+		}
+#endif
+		return res;
+	}
+};
+
+
+// Window space depth in [0, 1]. Depth values are quantized by the format before being compared,
+// so that the depth test sees exactly what is stored.
+
+struct Depth32F {
+	using Storage = float;
+
+	static Storage encode(float depth) {
+		return depth;
+	}
+
+	static float decode(Storage value) {
+		return value;
+	}
+};
+
+// 16 bit unsigned normalized depth
+struct Depth16 {
+	using Storage = uint16_t;
+
+	static Storage encode(float depth) {
+		return static_cast<Storage>(QuantizeUnorm<16>(depth));
+	}
+
+	static float decode(Storage value) {
+		return UnquantizeUnorm<16>(value);
+	}
+};
+
+// 24 bit unsigned normalized depth, stored in the low bits of 32 bits
+struct Depth24 {
+	using Storage = uint32_t;
+
+	static Storage encode(float depth) {
+		return QuantizeUnorm<24>(depth);
+	}
+
+	static float decode(Storage value) {
+		return UnquantizeUnorm<24>(value);
+	}
+};
@@ -1,7 +1,11 @@
 #pragma once
 
+#include <memory>
+#include <tuple>
+
 #include "vec.h"
 #include "texture.h"
+#include "color.h"
 #include "vertex.h"
 
 template <typename... Attr>
@@ -15,9 +19,22 @@ struct Fragment {
 
 };
 
+// Screen space derivatives of the fragment attributes, computed on 2x2 quads of pixels. Shaders
+// declared as operator()(Vec3 pos, const Derivatives<Attr...>& d, Attr... attr) receive them.
+template <typename... Attr>
+struct Derivatives {
+
+    std::tuple<Attr...> dx;
+    std::tuple<Attr...> dy;
+
+    Derivatives() = default;
+    Derivatives(std::tuple<Attr...> dx_, std::tuple<Attr...> dy_) : dx(std::move(dx_)), dy(std::move(dy_)) {}
+
+};
+
 template <typename... Attr>
 auto make_fragment(Vec3 pos, Attr... attr) {
-    return Fragment(pos, attr);
+    return Fragment(pos, attr...);
 }
 
 struct BasicFragShader {
@@ -30,23 +47,19 @@ struct BasicFragShader {
 
 struct TextureFragShader {
 
-    Texture texture;
+    // Shared between the copies of the shader, sampling does not modify it
+    std::shared_ptr<const Texture> texture;
     const float gamma = 2.2f;
+    const ColorCurve* curve = &GammaCurve(gamma);
+
+    TextureFragShader(std::shared_ptr<const Texture> t) : texture(std::move(t)) {}
+    TextureFragShader(std::shared_ptr<const Texture> t, float gamma_) : texture(std::move(t)), gamma(gamma_) {}
+
+    Vec4 operator()(Vec3 pos, const Derivatives<Vec2>& d, Vec2 tex) {
+
+        const Vec3 texColor = texture->sample(tex, std::get<0>(d.dx), std::get<0>(d.dy));
 
-    TextureFragShader(const Texture& t) : texture(t) {}
-    TextureFragShader(const Texture& t, float gamma_) : texture(t), gamma(gamma_) {}
-
-    Vec4 operator()(Vec3 pos, Vec2 tex) {
-        
-        const Vec3 texColor = texture.sample(tex.x, tex.y);
-        
-        const Vec4 outColor = {
-            powf(texColor.r, 1.f / gamma),
-            powf(texColor.g, 1.f / gamma),
-            powf(texColor.b, 1.f / gamma),
-            1.f
-        };
-        return outColor;
+        return Vec4(curve->fromLinear(texColor), 1.f);
     }
 
 };
@@ -2,38 +2,231 @@
 
 #include <vector>
 #include <algorithm>
+#include <bit>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
 
 #include "vec.h"
+#include "format.h"
+#include "layout.h"
+#include "simd.h"
+#include "threadpool.h"
 
-struct Framebuffer {
+// Framebuffer storing colors and depths in the given formats (see format.h) and memory layout
+// (see layout.h). Colors and depths are converted from floats when they are written.
+//
+// Multisampled framebuffers (sampleCount 4 or 8, see SamplePattern) keep a color and a depth for
+// each sample, the samples of a pixel next to each other. The pipeline shades once per pixel and
+// writes the covered samples; Resolve() then averages them into a framebuffer that can be output.
+// Pixel setters write every sample of the pixel, getters read sample s, the first by default.
+template <typename ColorFormat = ColorRGBA32F, typename DepthFormat = Depth32F, typename Layout = LinearLayout, int sampleCount = 1>
+struct BasicFramebuffer {
+
+	using ColorStorage = typename ColorFormat::Storage;
+	using DepthStorage = typename DepthFormat::Storage;
+
+	static constexpr int samples = sampleCount;
+	static_assert(samples == 1 || samples == 4 || samples == 8, "Supported sample counts are 1, 4 and 8");
+
+	// Side of the tiles of the coarse depth buffer
+	static constexpr int depthTileSize = 8;
 
 	const int w;
 	const int h;
+	const Layout layout;
 
-	std::vector<Vec4> colors;
-	std::vector<float> depths;
+	// Stored in the order given by the layout, see getColorRow() for row-major access. Sample s of the
+	// pixel at layout index i is at i * samples + s.
+	std::vector<ColorStorage> colors;
+	std::vector<DepthStorage> depths;
 
-	Framebuffer(int w_, int h_) : w(w_), h(h_), colors(w* h), depths(w* h) {}
+	// Coarse depth buffer: conservative range of the depths of each tile, used to reject
+	// occluded triangles and tiles before rasterization
+	const int depthTilesX;
+	std::vector<float> depthTileMin;
+	std::vector<float> depthTileMax;
 
-	Vec4 getColor(int x, int y) const {
-		return colors[y * w + x];
+	BasicFramebuffer(int w_, int h_) : w(w_), h(h_), layout(w, h), colors(size_t(layout.size()) * samples), depths(size_t(layout.size()) * samples),
+		depthTilesX((w + depthTileSize - 1) / depthTileSize),
+		depthTileMin(depthTilesX* ((h + depthTileSize - 1) / depthTileSize)),
+		depthTileMax(depthTileMin.size()) {}
+
+	size_t sampleIndex(int x, int y, int s) const {
+		return size_t(layout.index(x, y)) * samples + s;
+	}
+
+	Vec4 getColor(int x, int y, int s = 0) const {
+		return ColorFormat::decode(colors[sampleIndex(x, y, s)]);
 	}
 
 	void setColor(int x, int y, const Vec4& color) {
-		colors[y * w + x] = color;
+		setSampleColors(x, y, (1u << samples) - 1, color);
+	}
+
+	// Set the samples of pixel (x, y) in mask (bit s for sample s), encoding the color once
+	void setSampleColors(int x, int y, uint32_t mask, const Vec4& color) {
+		const ColorStorage value = ColorFormat::encode(color);
+		ColorStorage* pixel = &colors[sampleIndex(x, y, 0)];
+		for (int s = 0; s < samples; ++s) {
+			if (mask & (1u << s)) {
+				pixel[s] = value;
+			}
+		}
+	}
+
+	// Samples of pixel (x, y) in mask storing the same color as sample s
+	uint32_t sameColorSamples(int x, int y, int s, uint32_t mask) const {
+		const ColorStorage* pixel = &colors[sampleIndex(x, y, 0)];
+		uint32_t same = 0;
+		for (int i = 0; i < samples; ++i) {
+			if ((mask & (1u << i)) && std::memcmp(&pixel[i], &pixel[s], sizeof(ColorStorage)) == 0) {
+				same |= 1u << i;
+			}
+		}
+		return same;
+	}
+
+	// Copy the stored colors of row y to out, in row-major order
+	void getColorRow(int y, ColorStorage* out) const {
+		static_assert(samples == 1, "Multisampled framebuffers must be resolved first");
+		layout.copyRow(colors.data(), y, out);
+	}
+
+	float getDepth(int x, int y, int s = 0) const {
+		return DepthFormat::decode(depths[sampleIndex(x, y, s)]);
 	}
 
-	float getDepth(int x, int y) const {
-		return depths[y * w + x];
+	// Depth as it would be stored, to be used in depth tests
+	static float quantizeDepth(float depth) {
+		return DepthFormat::decode(DepthFormat::encode(depth));
 	}
 
 	void setDepth(int x, int y, float depth) {
-		depths[y * w + x] = depth;
+		const DepthStorage value = DepthFormat::encode(depth);
+		std::fill_n(&depths[sampleIndex(x, y, 0)], samples, value);
+		const float stored = DepthFormat::decode(value);
+		updateDepthTile(x, y, stored, stored);
+	}
+
+	// Depths of all the samples of pixel (x, y)
+	void getSampleDepths(int x, int y, float* out) const {
+		const DepthStorage* pixel = &depths[sampleIndex(x, y, 0)];
+		for (int s = 0; s < samples; ++s) {
+			out[s] = DepthFormat::decode(pixel[s]);
+		}
+	}
+
+	// Set the samples of pixel (x, y) in mask (bit s for sample s) to values[s]
+	void setSampleDepths(int x, int y, uint32_t mask, const float* values) {
+		DepthStorage* pixel = &depths[sampleIndex(x, y, 0)];
+		float lo = std::numeric_limits<float>::max();
+		float hi = std::numeric_limits<float>::lowest();
+		for (int s = 0; s < samples; ++s) {
+			if (mask & (1u << s)) {
+				pixel[s] = DepthFormat::encode(values[s]);
+				const float depth = DepthFormat::decode(pixel[s]);
+				lo = std::min(lo, depth);
+				hi = std::max(hi, depth);
+			}
+		}
+		updateDepthTile(x, y, lo, hi);
+	}
+
+	void updateDepthTile(int x, int y, float lo, float hi) {
+		const int tile = (y / depthTileSize) * depthTilesX + x / depthTileSize;
+		depthTileMin[tile] = std::min(depthTileMin[tile], lo);
+		depthTileMax[tile] = std::max(depthTileMax[tile], hi);
+	}
+
+	// Depth range of the tile containing pixel (x, y)
+	float getDepthTileMin(int x, int y) const {
+		return depthTileMin[(y / depthTileSize) * depthTilesX + x / depthTileSize];
+	}
+
+	float getDepthTileMax(int x, int y) const {
+		return depthTileMax[(y / depthTileSize) * depthTilesX + x / depthTileSize];
+	}
+
+	// Tighten the max depth of the tile containing pixel (x, y), when all its pixels are known
+	// to be no farther than depth
+	void shrinkDepthTileMax(int x, int y, float depth) {
+		float& tileMax = depthTileMax[(y / depthTileSize) * depthTilesX + x / depthTileSize];
+		tileMax = std::min(tileMax, depth);
 	}
 
 	void clear(const Vec4& color = { 0.f, 0.f, 0.f, 0.f }, float depth = 1.) {
-		std::ranges::fill(colors, color);
-		std::ranges::fill(depths, depth);
+		const DepthStorage depthValue = DepthFormat::encode(depth);
+		std::ranges::fill(colors, ColorFormat::encode(color));
+		std::ranges::fill(depths, depthValue);
+		std::ranges::fill(depthTileMin, DepthFormat::decode(depthValue));
+		std::ranges::fill(depthTileMax, DepthFormat::decode(depthValue));
 	}
 
 };
+
+using Framebuffer = BasicFramebuffer<>;
+
+// Average the samples of each pixel of src into the colors of dst, rows in parallel on pool, or
+// serially if pool is null. Depths of dst are left as they are. Linear 8 bit and float colors are
+// averaged as they are stored, with SIMD; other formats are decoded to floats first.
+template <typename ColorFormat, typename DepthFormat, typename Layout, int samples, typename DstDepthFormat, typename DstLayout>
+void Resolve(const BasicFramebuffer<ColorFormat, DepthFormat, Layout, samples>& src, BasicFramebuffer<ColorFormat, DstDepthFormat, DstLayout>& dst,
+	ThreadPool* pool = &DefaultThreadPool()) {
+
+	using Storage = typename ColorFormat::Storage;
+
+	if (src.w != dst.w || src.h != dst.h) {
+		throw std::invalid_argument("Resolve: framebuffers of different sizes");
+	}
+
+	const auto resolveRow = [&](int y, int) {
+		for (int x = 0; x < src.w; ++x) {
+			const Storage* in = &src.colors[src.sampleIndex(x, y, 0)];
+			Storage& out = dst.colors[dst.layout.index(x, y)];
+
+			if constexpr (samples == 1) {
+				out = in[0];
+			}
+#if defined(RASTERIZER_SSE2)
+			else if constexpr (std::is_same_v<ColorFormat, ColorRGBA8>) {
+				// Four samples per 128 bits, widened to 16 bits and summed, then rounded to nearest
+				const __m128i zero = _mm_setzero_si128();
+				__m128i sum = zero;
+				for (int s = 0; s < samples; s += 4) {
+					const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + s));
+					sum = _mm_add_epi16(sum, _mm_add_epi16(_mm_unpacklo_epi8(bytes, zero), _mm_unpackhi_epi8(bytes, zero)));
+				}
+				sum = _mm_add_epi16(sum, _mm_srli_si128(sum, 8));
+				sum = _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(samples / 2)), std::countr_zero(unsigned(samples)));
+				const int bytes = _mm_cvtsi128_si32(_mm_packus_epi16(sum, sum));
+				std::memcpy(out.data(), &bytes, 4);
+			}
+			else if constexpr (std::is_same_v<Storage, Vec4>) {
+				__m128 sum = _mm_setzero_ps();
+				for (int s = 0; s < samples; ++s) {
+					sum = _mm_add_ps(sum, _mm_loadu_ps(&in[s][0]));
+				}
+				_mm_storeu_ps(&out[0], _mm_mul_ps(sum, _mm_set1_ps(1.f / samples)));
+			}
+#endif
+			else {
+				Vec4 sum = ColorFormat::decode(in[0]);
+				for (int s = 1; s < samples; ++s) {
+					sum = sum + ColorFormat::decode(in[s]);
+				}
+				out = ColorFormat::encode(sum * (1.f / samples));
+			}
+		}
+	};
+
+	if (pool) {
+		pool->parallelFor(src.h, resolveRow);
+	}
+	else {
+		for (int y = 0; y < src.h; ++y) {
+			resolveRow(y, 0);
+		}
+	}
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+
+// Memory layouts of the framebuffer pixels. A layout maps pixel (x, y) to its position in the
+// color and depth arrays, and copies rows back to row-major order for the output.
+
+// Row-major order
+struct LinearLayout {
+
+	int w;
+	int h;
+
+	LinearLayout(int w_, int h_) : w(w_), h(h_) {}
+
+	int size() const {
+		return w * h;
+	}
+
+	int index(int x, int y) const {
+		return y * w + x;
+	}
+
+	// Copy the w pixels of row y to out, in order
+	template <typename T>
+	void copyRow(const T* data, int y, T* out) const {
+		std::copy_n(data + y * w, w, out);
+	}
+};
+
+// Square tiles stored contiguously, one after the other in row-major order. Inside a tile pixels
+// are stored in row-major order, or in Z-order (Morton order) if morton is true, which keeps
+// close pixels close in memory in both directions. The storage is padded to whole tiles.
+// With 8x8 tiles each tile matches a raster block and a tile of the coarse depth buffer.
+template <int tileSize = 8, bool morton = false>
+struct TiledLayout {
+
+	static_assert((tileSize & (tileSize - 1)) == 0 && tileSize <= 256, "Tile size must be a power of 2, up to 256");
+
+	static constexpr int tileShift = std::countr_zero(unsigned(tileSize));
+	static constexpr int tileMask = tileSize - 1;
+
+	int w;
+	int h;
+	int tilesX;
+	int tilesY;
+
+	TiledLayout(int w_, int h_) : w(w_), h(h_),
+		tilesX((w + tileSize - 1) / tileSize), tilesY((h + tileSize - 1) / tileSize) {}
+
+	int size() const {
+		return tilesX * tilesY * tileSize * tileSize;
+	}
+
+	// Spread the bits of v, leaving a zero bit between each pair
+	static constexpr int spreadBits(int v) {
+		v = (v | (v << 4)) & 0x0f0f;
+		v = (v | (v << 2)) & 0x3333;
+		v = (v | (v << 1)) & 0x5555;
+		return v;
+	}
+
+	static constexpr int offsetInTile(int x, int y) {
+		if constexpr (morton) {
+			return spreadBits(x) | (spreadBits(y) << 1);
+		}
+		else {
+			return (y << tileShift) | x;
+		}
+	}
+
+	int index(int x, int y) const {
+		const int tile = (y >> tileShift) * tilesX + (x >> tileShift);
+		return (tile << (2 * tileShift)) | offsetInTile(x & tileMask, y & tileMask);
+	}
+
+	template <typename T>
+	void copyRow(const T* data, int y, T* out) const {
+		const T* tileRow = data + (((y >> tileShift) * tilesX) << (2 * tileShift));
+		const int ty = y & tileMask;
+		for (int x0 = 0; x0 < w; x0 += tileSize) {
+			const T* tile = tileRow + ((x0 >> tileShift) << (2 * tileShift));
+			const int count = std::min(tileSize, w - x0);
+			if constexpr (morton) {
+				for (int tx = 0; tx < count; ++tx) {
+					out[x0 + tx] = tile[offsetInTile(tx, ty)];
+				}
+			}
+			else {
+				std::copy_n(tile + (ty << tileShift), count, out + x0);
+			}
+		}
+	}
+};
+
+using MortonLayout = TiledLayout<8, true>;
@@ -4,6 +4,7 @@
 #include <span>
 
 #include "vec.h"
+#include "simd.h"
 
 template <size_t N>
 struct Mat {
@@ -33,7 +34,7 @@ struct Mat {
 template <size_t N>
 Mat<N> operator*(const Mat<N>& v, float f) {
 	Mat<N> res = v;
-	for (int i = 0; i < 16; ++i) {
+	for (int i = 0; i < N * N; ++i) {
 		res[i] *= f;
 	}
 	return res;
@@ -66,9 +67,143 @@ Mat<N> operator*(const Mat<N>& a, const Mat<N>& b) {
 	return res;
 }
 
+template <size_t N>
+Mat<N> transpose(const Mat<N>& m) {
+	Mat<N> res;
+	for (int r = 0; r < N; ++r) {
+		for (int c = 0; c < N; ++c) {
+			res[c * N + r] = m[r * N + c];
+		}
+	}
+	return res;
+}
+
 using Mat4 = Mat<4>;
 
-Vec4 operator*(const Mat4& m, const Vec4& v);
+// Mat4 operations have a SIMD implementation, selected at compile time when available.
+// The scalar ones are always available, e.g. for comparison.
+
+namespace scalar {
+
+inline Mat4 mul(const Mat4& a, const Mat4& b) {
+	Mat4 res = 0.f;
+	for (int r = 0; r < 4; ++r) {
+		for (int c = 0; c < 4; ++c) {
+			for (int j = 0; j < 4; ++j) {
+				res[r * 4 + c] += a[r * 4 + j] * b[j * 4 + c];
+			}
+		}
+	}
+	return res;
+}
+
+inline Vec4 mul(const Mat4& m, const Vec4& v) {
+	Vec4 res = 0.f;
+	for (int i = 0; i < 4; ++i) {
+		for (int j = 0; j < 4; ++j) {
+			res[i] += m[i * 4 + j] * v[j];
+		}
+	}
+	return res;
+}
+
+inline Mat4 transpose(const Mat4& m) {
+	return ::transpose<4>(m);
+}
+
+// Inverse through the cofactors, the matrix MUST be invertible
+Mat4 inverse(const Mat4& m);
+
+}
+
+#if defined(RASTERIZER_SSE2)
+namespace simd {
+
+inline Mat4 mul(const Mat4& a, const Mat4& b) {
+	const __m128 b0 = _mm_loadu_ps(&b[0]);
+	const __m128 b1 = _mm_loadu_ps(&b[4]);
+	const __m128 b2 = _mm_loadu_ps(&b[8]);
+	const __m128 b3 = _mm_loadu_ps(&b[12]);
+	Mat4 res;
+	for (int r = 0; r < 4; ++r) {
+		// Row r of the result is the combination of the rows of b, weighted by row r of a
+		const __m128 r01 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[r * 4]), b0), _mm_mul_ps(_mm_set1_ps(a[r * 4 + 1]), b1));
+		const __m128 r23 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[r * 4 + 2]), b2), _mm_mul_ps(_mm_set1_ps(a[r * 4 + 3]), b3));
+		_mm_storeu_ps(&res[r * 4], _mm_add_ps(r01, r23));
+	}
+	return res;
+}
+
+inline Vec4 mul(const Mat4& m, const Vec4& v) {
+	const __m128 vv = _mm_loadu_ps(&v[0]);
+	__m128 r0 = _mm_mul_ps(_mm_loadu_ps(&m[0]), vv);
+	__m128 r1 = _mm_mul_ps(_mm_loadu_ps(&m[4]), vv);
+	__m128 r2 = _mm_mul_ps(_mm_loadu_ps(&m[8]), vv);
+	__m128 r3 = _mm_mul_ps(_mm_loadu_ps(&m[12]), vv);
+
+	// Horizontal sums of the four products at once
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+	Vec4 res;
+	_mm_storeu_ps(&res[0], _mm_add_ps(_mm_add_ps(r0, r1), _mm_add_ps(r2, r3)));
+	return res;
+}
+
+inline Mat4 transpose(const Mat4& m) {
+	__m128 r0 = _mm_loadu_ps(&m[0]);
+	__m128 r1 = _mm_loadu_ps(&m[4]);
+	__m128 r2 = _mm_loadu_ps(&m[8]);
+	__m128 r3 = _mm_loadu_ps(&m[12]);
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+	Mat4 res;
+	_mm_storeu_ps(&res[0], r0);
+	_mm_storeu_ps(&res[4], r1);
+	_mm_storeu_ps(&res[8], r2);
+	_mm_storeu_ps(&res[12], r3);
+	return res;
+}
+
+// Inverse through 2x2 blocks, the matrix MUST be invertible
+Mat4 inverse(const Mat4& m);
+
+}
+#endif
+
+inline Mat4 operator*(const Mat4& a, const Mat4& b) {
+#if defined(RASTERIZER_SSE2)
+	return simd::mul(a, b);
+#else
+	return scalar::mul(a, b);
+#endif
+}
+
+inline Vec4 operator*(const Mat4& m, const Vec4& v) {
+#if defined(RASTERIZER_SSE2)
+	return simd::mul(m, v);
+#else
+	return scalar::mul(m, v);
+#endif
+}
+
+inline Mat4 transpose(const Mat4& m) {
+#if defined(RASTERIZER_SSE2)
+	return simd::transpose(m);
+#else
+	return scalar::transpose(m);
+#endif
+}
+
+// m MUST be invertible
+inline Mat4 inverse(const Mat4& m) {
+#if defined(RASTERIZER_SSE2)
+	return simd::inverse(m);
+#else
+	return scalar::inverse(m);
+#endif
+}
+
+// Transform n points (x[i], y[i], z[i], 1) stored as structure of arrays, out = m * point
+void TransformPoints(const Mat4& m, size_t n, const float* x, const float* y, const float* z,
+	float* outX, float* outY, float* outZ, float* outW);
 
 Mat4 translation(const Vec3& v);
 Mat4 scaling(const Vec3& v);
@@ -1,8 +1,219 @@
 #pragma once
 
 #include <string>
-#include <fstream>
+#include <vector>
+#include <deque>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <type_traits>
 
 #include "framebuffer.h"
+#include "color.h"
+#include "threadpool.h"
 
-void WriteImg(const std::string& filename, const Framebuffer& framebuffer);
+enum class ImageFormat {
+	PPM,		// Binary P6
+	PNG,		// Filtered and deflate compressed
+	PNGStored,	// PNG with uncompressed data, faster to write
+	Raw,		// Pixels only, 3 bytes per pixel, top row first
+};
+
+// Format given by the file extension: .png, .raw or .rgb, anything else is PPM
+ImageFormat ImageFormatFromFilename(const std::string& filename);
+
+// 8 bit RGB image, top row first
+struct Image {
+
+	int w = 0;
+	int h = 0;
+	std::vector<uint8_t> rgb;
+
+	void resize(int w_, int h_) {
+		w = w_;
+		h = h_;
+		rgb.resize(size_t(w) * h * 3);
+	}
+
+	uint8_t* row(int y) {
+		return rgb.data() + size_t(y) * w * 3;
+	}
+
+};
+
+// Clamp n colors to [0, 1] and round them to 8 bits, dropping alpha
+void QuantizeRGB8(const Vec4* colors, int n, uint8_t* rgb);
+
+// Encode the image and write it with a few bulk writes
+void WriteImage(const std::string& filename, const Image& image, ImageFormat format);
+
+// Row buffers of ToImage, one set per worker. Kept from frame to frame, they only allocate when
+// the framebuffers get wider.
+struct ImageScratch {
+
+	struct Rows {
+		std::vector<std::byte> stored;	// In the storage of the color format
+		std::vector<Vec4> decoded;
+		std::vector<float> linear;
+	};
+
+	std::vector<Rows> workers;
+
+};
+
+// Convert the framebuffer to an image, rows in parallel on pool, or serially if pool is null
+// (e.g. on a thread running while the pool renders the next frame). The framebuffer origin is the
+// bottom left corner, so rows are flipped. Colors stored as floats are clamped to [0, 1] and
+// rounded, or encoded with curve if given (e.g. &SRGBCurve() when the shaders output linear
+// colors). 8 bit formats are copied as they are stored. Row buffers are taken from scratch when
+// given, otherwise allocated for the call.
+template <typename ColorFormat, typename DepthFormat, typename Layout>
+void ToImage(const BasicFramebuffer<ColorFormat, DepthFormat, Layout>& framebuffer, Image& image, const ColorCurve* curve = nullptr,
+	ThreadPool* pool = &DefaultThreadPool(), ImageScratch* scratch = nullptr) {
+
+	using Storage = typename ColorFormat::Storage;
+	static_assert(std::is_trivially_copyable_v<Storage> && alignof(Storage) <= alignof(std::max_align_t));
+
+	image.resize(framebuffer.w, framebuffer.h);
+
+	ImageScratch callScratch;
+	ImageScratch& buffers = scratch ? *scratch : callScratch;
+	const int workers = pool ? pool->size() : 1;
+	if (static_cast<int>(buffers.workers.size()) < workers) {
+		buffers.workers.resize(workers);
+	}
+	for (int i = 0; i < workers; ++i) {
+		buffers.workers[i].stored.resize(framebuffer.w * sizeof(Storage));
+	}
+
+	const auto convertRow = [&](int y, int worker) {
+
+		ImageScratch::Rows& rows = buffers.workers[worker];
+		Storage* row = reinterpret_cast<Storage*>(rows.stored.data());
+		uint8_t* rgb = image.row(framebuffer.h - 1 - y);
+		framebuffer.getColorRow(y, row);
+
+		if constexpr (requires { ColorFormat::bytesRGBA8; }) {
+			// Already stored as bytes, only alpha must be dropped
+			for (int x = 0; x < framebuffer.w; ++x) {
+				rgb[x * 3 + 0] = row[x][0];
+				rgb[x * 3 + 1] = row[x][1];
+				rgb[x * 3 + 2] = row[x][2];
+			}
+		}
+		else {
+			const Vec4* colors = nullptr;
+			if constexpr (std::is_same_v<Storage, Vec4>) {
+				colors = row;
+			}
+			else {
+				rows.decoded.resize(framebuffer.w);
+				for (int x = 0; x < framebuffer.w; ++x) {
+					rows.decoded[x] = ColorFormat::decode(row[x]);
+				}
+				colors = rows.decoded.data();
+			}
+
+			if (curve) {
+				std::vector<float>& values = rows.linear;
+				values.resize(framebuffer.w * 3);
+				for (int x = 0; x < framebuffer.w; ++x) {
+					values[x * 3 + 0] = colors[x].r;
+					values[x * 3 + 1] = colors[x].g;
+					values[x * 3 + 2] = colors[x].b;
+				}
+				curve->fromLinear8(values.data(), framebuffer.w * 3, rgb);
+			}
+			else {
+				QuantizeRGB8(colors, framebuffer.w, rgb);
+			}
+		}
+	};
+
+	if (pool) {
+		pool->parallelFor(framebuffer.h, convertRow);
+	}
+	else {
+		for (int y = 0; y < framebuffer.h; ++y) {
+			convertRow(y, 0);
+		}
+	}
+}
+
+// Write the framebuffer in the format given by the file extension
+template <typename ColorFormat, typename DepthFormat, typename Layout>
+void WriteImg(const std::string& filename, const BasicFramebuffer<ColorFormat, DepthFormat, Layout>& framebuffer,
+	const ColorCurve* curve = nullptr) {
+
+	Image image;
+	ToImage(framebuffer, image, curve);
+	WriteImage(filename, image, ImageFormatFromFilename(filename));
+}
+
+// Writes images on a background thread, so that the next frame can be rendered while the
+// previous one is encoded and written. Framebuffers are converted on the calling thread (which is
+// quick), so the framebuffer can be reused as soon as write() returns. At most maxPending images
+// wait in the queue, write() blocks beyond that. Their buffers are recycled.
+// Errors of the writer thread are rethrown by the next call to write() or wait(). The row buffers
+// of the conversion are kept too, see ImageScratch.
+class AsyncImageWriter {
+
+public:
+
+	explicit AsyncImageWriter(int maxPending = 2);
+	~AsyncImageWriter();
+
+	AsyncImageWriter(const AsyncImageWriter&) = delete;
+	AsyncImageWriter& operator=(const AsyncImageWriter&) = delete;
+
+	template <typename ColorFormat, typename DepthFormat, typename Layout>
+	void write(const std::string& filename, const BasicFramebuffer<ColorFormat, DepthFormat, Layout>& framebuffer,
+		const ColorCurve* curve = nullptr) {
+
+		Image image = acquire();
+		{
+			std::lock_guard lock(scratchMutex);
+			ToImage(framebuffer, image, curve, &DefaultThreadPool(), &scratch);
+		}
+		write(filename, std::move(image), ImageFormatFromFilename(filename));
+	}
+
+	void write(const std::string& filename, Image image, ImageFormat format);
+
+	// Wait until all the queued images are written
+	void wait();
+
+private:
+
+	struct Job {
+		std::string filename;
+		Image image;
+		ImageFormat format;
+	};
+
+	// Image buffer from a written job if any, or a new one
+	Image acquire();
+
+	void writerLoop();
+	void rethrowError();
+
+	const size_t maxPending;
+
+	std::mutex mutex;
+	std::condition_variable queueCond;		// Signaled when a job is queued or on exit
+	std::condition_variable doneCond;		// Signaled when a job is done
+	std::deque<Job> queue;
+	std::vector<Image> freeImages;
+
+	std::mutex scratchMutex;	// Conversions by concurrent calls of write()
+	ImageScratch scratch;
+	bool busy = false;
+	bool stopping = false;
+	std::exception_ptr error;
+
+	std::thread thread;
+
+};
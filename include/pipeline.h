@@ -1,12 +1,27 @@
 #pragma once
 
+#include <array>
+#include <bit>
+#include <optional>
 #include <vector>
 #include <tuple>
+#include <span>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
 
 #include "vec.h"
 #include "vertex.h"
 #include "fragment.h"
 #include "framebuffer.h"
+#include "threadpool.h"
+#include "arena.h"
+#include "raster.h"
+#include "clip.h"
+#include "state.h"
+#include "visibility.h"
+#include "stats.h"
 
 
 //template <typename Head, typename... Tail>
@@ -17,111 +32,1000 @@
 //}
 
 
-template <size_t Start, typename... Vals>
-constexpr void _tuple_interpolate(std::tuple<Vals...>& res,
-	const std::tuple<Vals...>& a, const std::tuple<Vals...>& b, const std::tuple<Vals...>& c,
-	float wa, float wb, float wc) {
-	if constexpr (Start < std::tuple_size_v<std::remove_reference_t<decltype(res)>>) {
-		std::get<Start>(res) = std::get<Start>(a) * wa + std::get<Start>(b) * wb + std::get<Start>(c) * wc;
-		_tuple_interpolate<Start + 1>(res, a, b, c, wa, wb, wc);
-	}
+// Element-wise a * wa + b * wb
+template <typename... Vals>
+constexpr std::tuple<Vals...> tuple_combine(const std::tuple<Vals...>& a, const std::tuple<Vals...>& b, float wa, float wb) {
+	return [&]<size_t... I>(std::index_sequence<I...>) {
+		return std::tuple<Vals...>((std::get<I>(a) * wa + std::get<I>(b) * wb)...);
+	}(std::index_sequence_for<Vals...>{});
 }
 
+// Element-wise base + a * wa + b * wb
 template <typename... Vals>
-constexpr std::tuple<Vals...> tuple_interpolate(
-	const std::tuple<Vals...>& a, const std::tuple<Vals...>& b, const std::tuple<Vals...>& c,
-	float wa, float wb, float wc) {
+constexpr std::tuple<Vals...> tuple_affine(const std::tuple<Vals...>& base, const std::tuple<Vals...>& a, const std::tuple<Vals...>& b,
+	float wa, float wb) {
+	return [&]<size_t... I>(std::index_sequence<I...>) {
+		return std::tuple<Vals...>((std::get<I>(base) + std::get<I>(a) * wa + std::get<I>(b) * wb)...);
+	}(std::index_sequence_for<Vals...>{});
+}
+
+
+enum class RasterMode {
+	Immediate,	// Single thread rasterization, all fragments are generated first and then shaded
+	Streaming,	// Single thread rasterization, each fragment is depth tested and shaded as soon as it is generated
+	Binned,		// Triangles are sorted into screen tiles, and tiles are rendered in parallel
+	Deferred,	// Binned visibility pass, then each visible pixel is shaded once, rows in parallel. Blending
+				// states and shaders with late depth tests fall back to Binned.
+};
+// Multisampled framebuffers are drawn per triangle, see DrawTriangleMultisample: Immediate falls back
+// to Streaming, and Deferred to Binned.
+
+struct DrawOptions {
+	RasterMode mode = RasterMode::Immediate;
+	int tileSize = 64;	// Side of the square tiles used by the binned mode
+	int threads = 0;	// Max number of threads used by the parallel stages, 0 means the whole pool
+	ThreadPool* pool = nullptr;	// nullptr means DefaultThreadPool()
+	CullMode cull = CullMode::None;
+	FrontFace frontFace = FrontFace::CounterClockwise;
+	VisibilityBuffer* visibility = nullptr;	// Used by the deferred mode, nullptr means a new one for each draw, from the arena if set
+	OverdrawMap* overdraw = nullptr;	// Fragments generated per pixel, only counted by instrumented draws
+	FrameArena* arena = nullptr;	// Transient memory of the draws, made for their pool; nullptr means the heap
+};
+
+// Arena of the calling thread for the transient memory of a draw, nullptr for the heap
+inline Arena* LocalArena(const DrawOptions& options) {
+	return options.arena ? &options.arena->local() : nullptr;
+}
+
+// Fragment counters of a draw, empty unless the state is Instrumented
+template <typename State>
+using CountersOf = DrawCounters<IsInstrumented<State>()>;
+
+// Fragment shaders are depth tested before shading, and occluded blocks of pixels are skipped
+// altogether. Shaders that must run for every covered pixel can opt out declaring
+// static constexpr bool lateDepthTest = true;
+template <typename Frag>
+constexpr bool EarlyDepthTest() {
+	if constexpr (requires { Frag::lateDepthTest; }) {
+		return !Frag::lateDepthTest;
+	}
+	else {
+		return true;
+	}
+}
+
+// Window space depth, in range [0, 1]. It is clamped to the depth range of the triangle, so that
+// it is consistent with the coarse depth tests.
+template <typename Vert>
+float InterpolateDepth(const Triangle& tri, const Vert& a, const Vert& b, const Vert& c, float wa, float wb, float wc) {
+	return std::clamp((wa * a.pos.z + wb * b.pos.z + wc * c.pos.z) / 2.f + 0.5f, tri.zMin, tri.zMax);
+}
+
+// Attributes of a triangle, set up once per triangle for perspective correct interpolation.
+// Attributes are affine in the perspective correct barycentrics (u, v) of vertices a and b:
+// attr = c + (a - c) * u + (b - c) * v. u and v are computed per pixel from the screen space
+// barycentrics, which the rasterizer steps incrementally, weighted by the 1/w of the vertices.
+// The division is shared by all the attributes, each component then costs two multiply-adds.
+template <typename Vert>
+struct TriangleAttributes {
+
+	using Attr = decltype(Vert::attr);
+
+	Attr base;		// Attributes of c
+	Attr du;		// a - c
+	Attr dv;		// b - c
+	float qa, qb, qc;	// 1/w of the vertices
+
+	TriangleAttributes(const Vert& a, const Vert& b, const Vert& c) :
+		base(c.attr), du(tuple_combine(a.attr, c.attr, 1.f, -1.f)), dv(tuple_combine(b.attr, c.attr, 1.f, -1.f)),
+		qa(a.pos.w), qb(b.pos.w), qc(c.pos.w) {}
+
+	// Perspective correct barycentrics of a and b given the screen space ones
+	void barycentrics(float wa, float wb, float wc, float& u, float& v) const {
+		const float pa = wa * qa;
+		const float pb = wb * qb;
+		const float r = 1.f / (pa + pb + wc * qc);
+		u = pa * r;
+		v = pb * r;
+	}
+
+	Attr at(float u, float v) const {
+		return tuple_affine(base, du, dv, u, v);
+	}
+
+};
+
+template <typename Vert>
+auto InterpolateFragment(const TriangleAttributes<Vert>& attrs, float x, float y, float z, float wa, float wb, float wc) {
+
+	const Vec3 fragPos{ x, y, z };
+
+	float u, v;
+	attrs.barycentrics(wa, wb, wc, u, v);
+
+	return std::apply([&fragPos](auto&&... attr) {
+		return Fragment(fragPos, attr...);
+		}, attrs.at(u, v));
+}
+
+template <typename Vert>
+using FragmentOf = decltype(InterpolateFragment(std::declval<const TriangleAttributes<Vert>&>(), 0.f, 0.f, 0.f, 0.f, 0.f, 0.f));
 
-	std::tuple<Vals...> res;
-	_tuple_interpolate<0>(res, a, b, c, wa, wb, wc);
-	return res;
+// Derivatives of the attributes over the 2x2 quad with its first pixel at (dx, dy) in the block, as
+// differences between the attributes of the quad pixels, covered or not. The attributes are affine
+// in the perspective correct barycentrics, so the differences come from the differences of those.
+template <typename Vert>
+auto QuadDerivatives(const Triangle& tri, const RasterBlock& block, const TriangleAttributes<Vert>& attrs, int dx, int dy) {
+
+	float u[3], v[3];
+	const int offsets[3][2] = { { 0, 0 }, { 1, 0 }, { 0, 1 } };
+	for (int i = 0; i < 3; ++i) {
+		float wa, wb, wc;
+		BlockBarycentrics(tri, block, dx + offsets[i][0], dy + offsets[i][1], wa, wb, wc);
+		attrs.barycentrics(wa, wb, wc, u[i], v[i]);
+	}
+
+	return Derivatives(
+		tuple_combine(attrs.du, attrs.dv, u[1] - u[0], v[1] - v[0]),
+		tuple_combine(attrs.du, attrs.dv, u[2] - u[0], v[2] - v[0]));
 }
 
+// Derivatives of the quads of a block, each computed when first needed
+template <typename Vert>
+struct QuadDerivativesCache {
+
+	using Derivs = decltype(QuadDerivatives(std::declval<const Triangle&>(), std::declval<const RasterBlock&>(),
+		std::declval<const TriangleAttributes<Vert>&>(), 0, 0));
 
+	static constexpr int quadsX = kBlockSize / 2;
+
+	std::array<Derivs, quadsX * quadsX> quads;
+	uint32_t computed = 0;
+	int blockX = -1;
+	int blockY = -1;
+
+	const Derivs& get(const Triangle& tri, const RasterBlock& block, const TriangleAttributes<Vert>& attrs, int px, int py) {
+		if (block.x != blockX || block.y != blockY) {
+			blockX = block.x;
+			blockY = block.y;
+			computed = 0;
+		}
+		const int qx = (px - block.x) / 2;
+		const int qy = (py - block.y) / 2;
+		const int quad = qy * quadsX + qx;
+		if (!(computed & (1u << quad))) {
+			quads[quad] = QuadDerivatives(tri, block, attrs, qx * 2, qy * 2);
+			computed |= 1u << quad;
+		}
+		return quads[quad];
+	}
+};
+
+// True if the fragment shader takes the derivatives of the attributes, see Derivatives
+template <typename Frag, typename Frg>
+struct UsesDerivatives : std::false_type {};
+
+template <typename Frag, typename... Attr>
+struct UsesDerivatives<Frag, Fragment<Attr...>> : std::bool_constant<std::is_invocable_v<Frag&, Vec3, const Derivatives<Attr...>&, Attr...>> {};
+
+template <typename Frag, typename Frg>
+Vec4 ShadeFragment(Frag& fShader, const Frg& frag) {
+	return std::apply([&frag, &fShader](auto&&... attrs) {
+		return fShader(frag.pos, attrs...);
+		}, frag.attr);
+}
+
+template <typename Frag, typename Frg, typename Derivs>
+Vec4 ShadeFragment(Frag& fShader, const Frg& frag, const Derivs& derivs) {
+	return std::apply([&frag, &fShader, &derivs](auto&&... attrs) {
+		return fShader(frag.pos, derivs, attrs...);
+		}, frag.attr);
+}
 
-template <typename VertAttr, typename Vert, typename Frag>
-void DrawTriangles(Framebuffer& framebuffer, std::span<VertAttr> vertices, Vert vShader, Frag fShader) {
+// Update the color of a fragment that passed the depth test
+template <typename State, typename FB>
+void WriteColor(FB& framebuffer, int x, int y, const Vec4& color) {
+	if constexpr (State::readsColor) {
+		framebuffer.setColor(x, y, BlendColor<State>(framebuffer.getColor(x, y), color));
+	}
+	else if constexpr (State::writesColor) {
+		framebuffer.setColor(x, y, color);
+	}
+}
 
-	std::vector<decltype(Fragment(std::apply(vShader, vertices[0])))> fragments;
+// Update depth and color of a fragment that passed the depth test
+template <typename State, typename FB>
+void BlendFragment(FB& framebuffer, int x, int y, float z, const Vec4& color) {
 
-	for (int i = 0; i < vertices.size() / 3; ++i) {
+	if constexpr (State::depthWrite) {
+		framebuffer.setDepth(x, y, z);
+	}
+	WriteColor<State>(framebuffer, x, y, color);
+}
 
-		auto a = std::apply(vShader, vertices[i * 3]);		// it works with const Vertex a, but how?
-		auto b = std::apply(vShader, vertices[i * 3 + 1]);
-		auto c = std::apply(vShader, vertices[i * 3 + 2]);
+// Depth test and blending of a shaded fragment, false if it failed the test
+template <typename State, typename FB>
+bool WriteFragment(FB& framebuffer, int x, int y, float z, const Vec4& color) {
 
-		// Clipping is prformed afterwards
+	// Z-test
+	if constexpr (State::depthFunc != DepthFunc::Always) {
+		if (!DepthTest<State>(z, framebuffer.getDepth(x, y))) {
+			return false;
+		}
+	}
+	BlendFragment<State>(framebuffer, x, y, z, color);
+	return true;
+}
 
-		a.pos = a.pos / a.pos.w;
-		b.pos = b.pos / b.pos.w;
-		c.pos = c.pos / c.pos.w;
+static_assert(Framebuffer::depthTileSize == kBlockSize, "Raster blocks must match the tiles of the coarse depth buffer");
 
-		// Find fragments
+// Hierarchical depth test: false if no fragment of the triangle in the block can pass the depth test
+template <typename State, typename Frag, typename FB>
+bool BlockMayBeVisible(const FB& framebuffer, const Triangle& tri, int bx, int by) {
+	if constexpr (!EarlyDepthTest<Frag>() || State::depthFunc == DepthFunc::Always) {
+		return true;
+	}
+	else if constexpr (State::depthFunc == DepthFunc::Less) {
+		return tri.zMin < framebuffer.getDepthTileMax(bx, by);
+	}
+	else {
+		// Fragment depths are quantized, so the range of the triangle is too
+		return DepthRangeMayPass<State>(framebuffer.quantizeDepth(tri.zMin), framebuffer.quantizeDepth(tri.zMax),
+			framebuffer.getDepthTileMin(bx, by), framebuffer.getDepthTileMax(bx, by));
+	}
+}
 
-		const int w = framebuffer.w;
-		const int h = framebuffer.h;
+// Rasterize a triangle inside the rectangle [x0, x1) x [y0, y1), calling fn(block, px, py, z, wa, wb, wc)
+// for each fragment that passes the early depth test, or for every fragment if the shader opted out
+// of it. z is the quantized depth, written by fn. Blocks the triangle covers entirely then update
+// the coarse depth buffer.
+template <typename State, typename Frag, typename FB, typename Vert, typename Fn>
+void RasterizeFragments(FB& framebuffer, std::span<const Vert> verts, const Triangle& tri, int x0, int y0, int x1, int y1,
+	CountersOf<State>& counters, Fn&& fn) {
 
-		// Convert coordinates to window space
-		const Vec2 aPos{ (a.pos.x - -1.f) / 2.f * w, (a.pos.y - -1.f) / 2.f * h };
-		const Vec2 bPos{ (b.pos.x - -1.f) / 2.f * w, (b.pos.y - -1.f) / 2.f * h };
-		const Vec2 cPos{ (c.pos.x - -1.f) / 2.f * w, (c.pos.y - -1.f) / 2.f * h };
+	constexpr bool earlyZ = EarlyDepthTest<Frag>();
 
-		// Bounding box with clipping
-		const float top = std::min((float)h, std::ceil(std::max({ aPos.y, bPos.y, cPos.y })));
-		const float bottom = std::max(0.f, std::floor(std::min({ aPos.y, bPos.y, cPos.y })));
-		const float left = std::max(0.f, std::floor(std::min({ aPos.x, bPos.x, cPos.x })));
-		const float right = std::min((float)w, std::ceil(std::max({ aPos.x, bPos.x, cPos.x })));
+	const auto& a = verts[tri.a];
+	const auto& b = verts[tri.b];
+	const auto& c = verts[tri.c];
 
-		// Examine the internal of the triangle line by line
-		const float den = (bPos.y - cPos.y) * (aPos.x - cPos.x) + (cPos.x - bPos.x) * (aPos.y - cPos.y);
+	RasterizeBlocks(tri, x0, y0, x1, y1, [&](int bx, int by) {
+		return BlockMayBeVisible<State, Frag>(framebuffer, tri, bx, by);
+		}, [&](const RasterBlock& block) {
 
-		for (float y = bottom + 0.5f; y < top; ++y) {
-			for (float x = left + 0.5f; x < right; ++x) {
+			// All the fragments of the block pass the depth test, no need to read the depths
+			const bool visible = DepthRangeAlwaysPasses<State>(framebuffer.quantizeDepth(tri.zMin), framebuffer.quantizeDepth(tri.zMax),
+				framebuffer.getDepthTileMin(block.x, block.y), framebuffer.getDepthTileMax(block.x, block.y));
+			float blockMax = 0.f;
 
-				const float wa = ((bPos.y - cPos.y) * (x - cPos.x) + (cPos.x - bPos.x) * (y - cPos.y)) / den;
-				const float wb = ((cPos.y - aPos.y) * (x - cPos.x) + (aPos.x - cPos.x) * (y - cPos.y)) / den;
-				const float wc = 1.f - wa - wb;
-				constexpr float tol = 0; // 0.00001f;
-				if (wa >= -tol && wb >= -tol && wc >= -tol && wa <= 1 + tol && wb <= 1 + tol && wc <= 1 + tol) {
-					// New fragment
+			ForEachPixel(tri, block, [&](float x, float y, float wa, float wb, float wc) {
 
-					const float z = (wa * a.pos.z + wb * b.pos.z + wc * c.pos.z) / 2.f + 0.5f;
-					const Vec3 fragPos{ x, y, z };
+				const int px = static_cast<int>(x);
+				const int py = static_cast<int>(y);
 
-					const auto fragAttr = tuple_interpolate(a.attr, b.attr, c.attr, wa, wb, wc);
+				const float z = framebuffer.quantizeDepth(InterpolateDepth(tri, a, b, c, wa, wb, wc));
+				blockMax = std::max(blockMax, z);
+				counters.generated(px, py);
 
-					auto fragment = std::apply([&fragPos](auto&&... attrs) {
-						return Fragment(fragPos, attrs...);
-						}, fragAttr);
+				if constexpr (earlyZ) {
+					const bool passed = visible || DepthTest<State>(z, framebuffer.getDepth(px, py));
+					counters.depthTest(passed);
+					if (!passed) {
+						return;
+					}
+				}
+				fn(block, px, py, z, wa, wb, wc);
+				});
 
-					fragments.push_back(fragment);
+			// If the triangle covers the whole tile, no pixel of the tile can be farther than it
+			if constexpr (CoveringTriangleBoundsTileMax<State>()) {
+				if (block.mask == BlockRectMask(block.x, block.y, 0, 0, framebuffer.w, framebuffer.h)) {
+					framebuffer.shrinkDepthTileMax(block.x, block.y, blockMax);
 				}
 			}
-		}
+		});
+}
+
+// Multisampled DrawTriangleStreaming. Coverage and depth tests are per sample, but each pixel with
+// covered samples passing the test is shaded only once, at its center (covered or not). The color is
+// then written to those samples, blended once per distinct stored color.
+template <typename State, typename FB, typename Vert, typename Frag>
+void DrawTriangleMultisample(FB& framebuffer, Frag& fShader, std::span<const Vert> verts, const Triangle& tri,
+	int x0, int y0, int x1, int y1, CountersOf<State>& counters) {
+
+	constexpr int samples = FB::samples;
+	constexpr bool earlyZ = EarlyDepthTest<Frag>();
+	constexpr bool derivatives = UsesDerivatives<Frag, FragmentOf<Vert>>::value;
+
+	const auto& a = verts[tri.a];
+	const auto& b = verts[tri.b];
+	const auto& c = verts[tri.c];
+	const TriangleAttributes<Vert> attrs(a, b, c);
+	[[maybe_unused]] QuadDerivativesCache<Vert> quads;
+
+	// Depth offsets of the samples from the pixel center
+	const SampleBarycentrics<samples> offsets(tri);
+	float dz[samples];
+	for (int s = 0; s < samples; ++s) {
+		dz[s] = (offsets.wa[s] * a.pos.z + offsets.wb[s] * b.pos.z + offsets.wc[s] * c.pos.z) / 2.f;
+	}
+
+	RasterizeBlocks<samples>(tri, x0, y0, x1, y1, [&](int bx, int by) {
+		return BlockMayBeVisible<State, Frag>(framebuffer, tri, bx, by);
+		}, [&](const MultisampleBlock<samples>& block) {
+
+			const bool visible = DepthRangeAlwaysPasses<State>(framebuffer.quantizeDepth(tri.zMin), framebuffer.quantizeDepth(tri.zMax),
+				framebuffer.getDepthTileMin(block.x, block.y), framebuffer.getDepthTileMax(block.x, block.y));
+			float blockMax = 0.f;
+
+			ForEachPixel(tri, block, [&](float x, float y, float wa, float wb, float wc) {
+
+				const int px = static_cast<int>(x);
+				const int py = static_cast<int>(y);
+				const uint64_t bit = uint64_t(1) << ((py - block.y) * kBlockSize + (px - block.x));
+
+				const float zCenter = (wa * a.pos.z + wb * b.pos.z + wc * c.pos.z) / 2.f + 0.5f;
+				uint32_t covered = 0;
+				float z[samples];
+				for (int s = 0; s < samples; ++s) {
+					z[s] = framebuffer.quantizeDepth(std::clamp(zCenter + dz[s], tri.zMin, tri.zMax));
+					if (block.sampleMasks[s] & bit) {
+						covered |= 1u << s;
+						blockMax = std::max(blockMax, z[s]);
+					}
+				}
+				counters.generated(px, py);
+
+				// Covered samples passing the depth test
+				const auto depthTest = [&]() {
+					if (visible) {
+						return covered;
+					}
+					float depths[samples];
+					framebuffer.getSampleDepths(px, py, depths);
+					uint32_t passed = 0;
+					for (int s = 0; s < samples; ++s) {
+						passed |= uint32_t(DepthTest<State>(z[s], depths[s])) << s;
+					}
+					return passed & covered;
+				};
+
+				uint32_t passed = covered;
+				if constexpr (earlyZ) {
+					passed = depthTest();
+					counters.depthTest(passed != 0);
+					if (passed == 0) {
+						return;
+					}
+				}
+
+				const auto frag = InterpolateFragment(attrs, x, y, framebuffer.quantizeDepth(std::clamp(zCenter, tri.zMin, tri.zMax)), wa, wb, wc);
+				Vec4 color;
+				if constexpr (derivatives) {
+					color = ShadeFragment(fShader, frag, quads.get(tri, block, attrs, px, py));
+				}
+				else {
+					color = ShadeFragment(fShader, frag);
+				}
+				counters.shaded();
+
+				if constexpr (!earlyZ) {
+					passed = depthTest();
+					counters.depthTest(passed != 0);
+					if (passed == 0) {
+						return;
+					}
+				}
+
+				if constexpr (State::depthWrite) {
+					framebuffer.setSampleDepths(px, py, passed, z);
+				}
+				if constexpr (State::readsColor) {
+					// Samples storing the same color are blended once, which is the common case
+					for (uint32_t mask = passed; mask != 0;) {
+						const int s = std::countr_zero(mask);
+						const uint32_t same = framebuffer.sameColorSamples(px, py, s, mask);
+						framebuffer.setSampleColors(px, py, same, BlendColor<State>(framebuffer.getColor(px, py, s), color));
+						mask &= ~same;
+					}
+				}
+				else if constexpr (State::writesColor) {
+					framebuffer.setSampleColors(px, py, passed, color);
+				}
+				counters.written();
+				});
+
+			// If the triangle covers every sample of the tile, no sample of the tile can be farther than it
+			if constexpr (CoveringTriangleBoundsTileMax<State>()) {
+				uint64_t all = block.mask;
+				for (int s = 0; s < samples; ++s) {
+					all &= block.sampleMasks[s];
+				}
+				if (all == BlockRectMask(block.x, block.y, 0, 0, framebuffer.w, framebuffer.h)) {
+					framebuffer.shrinkDepthTileMax(block.x, block.y, blockMax);
+				}
+			}
+		});
+}
+
+// Rasterize a triangle inside the rectangle [x0, x1) x [y0, y1), depth testing each fragment as soon
+// as it is generated and only interpolating and shading it if it passes. No fragment is stored, so
+// memory does not grow with the scene overdraw.
+template <typename State, typename FB, typename Vert, typename Frag>
+void DrawTriangleStreaming(FB& framebuffer, Frag& fShader, std::span<const Vert> verts, const Triangle& tri,
+	int x0, int y0, int x1, int y1, CountersOf<State>& counters) {
+
+	if constexpr (FB::samples > 1) {
+		DrawTriangleMultisample<State>(framebuffer, fShader, verts, tri, x0, y0, x1, y1, counters);
 	}
+	else {
+		constexpr bool earlyZ = EarlyDepthTest<Frag>();
+		constexpr bool derivatives = UsesDerivatives<Frag, FragmentOf<Vert>>::value;
+
+		const TriangleAttributes<Vert> attrs(verts[tri.a], verts[tri.b], verts[tri.c]);
+		[[maybe_unused]] QuadDerivativesCache<Vert> quads;
+
+		RasterizeFragments<State, Frag>(framebuffer, verts, tri, x0, y0, x1, y1, counters,
+			[&](const RasterBlock& block, int px, int py, float z, float wa, float wb, float wc) {
+
+				const auto frag = InterpolateFragment(attrs, px + 0.5f, py + 0.5f, z, wa, wb, wc);
+				Vec4 color;
+				if constexpr (derivatives) {
+					color = ShadeFragment(fShader, frag, quads.get(tri, block, attrs, px, py));
+				}
+				else {
+					color = ShadeFragment(fShader, frag);
+				}
+				counters.shaded();
+
+				if constexpr (earlyZ) {
+					BlendFragment<State>(framebuffer, px, py, z, color);
+					counters.written();
+				}
+				else {
+					const bool passed = WriteFragment<State>(framebuffer, px, py, z, color);
+					counters.depthTest(passed);
+					if (passed) {
+						counters.written();
+					}
+				}
+			});
+	}
+}
+
+template <typename State, typename FB, typename Vert, typename Frag>
+void DrawImmediate(FB& framebuffer, std::span<const Vert> verts, std::span<const Triangle> triangles, Frag& fShader,
+	const DrawOptions& options, DrawStats& stats) {
+
+	constexpr bool earlyZ = EarlyDepthTest<Frag>();
+	constexpr bool derivatives = UsesDerivatives<Frag, FragmentOf<Vert>>::value;
+
+	StageTimer<IsInstrumented<State>()> timer;
+	CountersOf<State> counters;
+	counters.overdraw = options.overdraw;
+
+	using Derivs = typename QuadDerivativesCache<Vert>::Derivs;
+	Arena* arena = LocalArena(options);
+	ArenaVector<FragmentOf<Vert>> fragments{ ArenaAllocator<FragmentOf<Vert>>(arena) };
+	ArenaVector<Derivs> fragmentDerivatives{ ArenaAllocator<Derivs>(arena) };	// Only for shaders using them
+
+	// Find fragments
+	for (const Triangle& tri : triangles) {
+		const auto& a = verts[tri.a];
+		const auto& b = verts[tri.b];
+		const auto& c = verts[tri.c];
+		const TriangleAttributes<Vert> attrs(a, b, c);
+		RasterizeBlocks(tri, 0, 0, framebuffer.w, framebuffer.h, [&](int bx, int by) {
+			return BlockMayBeVisible<State, Frag>(framebuffer, tri, bx, by);
+			}, [&](const RasterBlock& block) {
+				[[maybe_unused]] QuadDerivativesCache<Vert> quads;
+				ForEachPixel(tri, block, [&](float x, float y, float wa, float wb, float wc) {
+					const int px = static_cast<int>(x);
+					const int py = static_cast<int>(y);
+					const float z = framebuffer.quantizeDepth(InterpolateDepth(tri, a, b, c, wa, wb, wc));
+					counters.generated(px, py);
+
+					// Depths only change in the direction that makes the test harder to pass during
+					// the draw, so fragments failing the test now can be discarded
+					if constexpr (earlyZ && State::depthFunc != DepthFunc::Always) {
+						if (!DepthTest<State>(z, framebuffer.getDepth(px, py))) {
+							counters.depthTest(false);
+							return;
+						}
+					}
+					fragments.push_back(InterpolateFragment(attrs, x, y, z, wa, wb, wc));
+					if constexpr (derivatives) {
+						fragmentDerivatives.push_back(quads.get(tri, block, attrs, px, py));
+					}
+					});
+			});
+	}
+
+	stats.rasterMs = timer.lap();
 
 	// Now draw fragments
 	for (int i = 0; i < fragments.size(); ++i) {
 
 		const auto& frag = fragments[i];
 
-		Vec4 color = std::apply([&frag, &fShader](auto&&... attrs) {
-			return fShader(frag.pos, attrs...);
-			}, frag.attr);
+		Vec4 color;
+		if constexpr (derivatives) {
+			color = ShadeFragment(fShader, frag, fragmentDerivatives[i]);
+		}
+		else {
+			color = ShadeFragment(fShader, frag);
+		}
+		counters.shaded();
+
+		const bool passed = WriteFragment<State>(framebuffer, static_cast<int>(frag.pos.x), static_cast<int>(frag.pos.y), frag.pos.z, color);
+		counters.depthTest(passed);
+		if (passed) {
+			counters.written();
+		}
+	}
+
+	stats.shadeMs = timer.lap();
+	stats.add(counters);
+}
+
+template <typename State, typename FB, typename Vert, typename Frag>
+void DrawStreaming(FB& framebuffer, std::span<const Vert> verts, std::span<const Triangle> triangles, Frag& fShader,
+	const DrawOptions& options, DrawStats& stats) {
+
+	StageTimer<IsInstrumented<State>()> timer;
+	CountersOf<State> counters;
+	counters.overdraw = options.overdraw;
+
+	for (const Triangle& tri : triangles) {
+		DrawTriangleStreaming<State>(framebuffer, fShader, verts, tri, 0, 0, framebuffer.w, framebuffer.h, counters);
+	}
+
+	stats.rasterMs = timer.lap();
+	stats.add(counters);
+}
+
+// Number of workers of the parallel stages of a draw
+inline int DrawWorkers(const ThreadPool& pool, const DrawOptions& options) {
+	return std::min(pool.size(), options.threads > 0 ? options.threads : pool.size());
+}
+
+// The frame arena of a draw must have an arena for each of its workers, and for the calling thread.
+// Checked by the draws before they start, on the calling thread: an exception thrown by
+// FrameArena::local() on a worker would terminate the program.
+inline void CheckDrawArena(const DrawOptions& options) {
+	if (!options.arena) {
+		return;
+	}
+	const ThreadPool& pool = options.pool ? *options.pool : DefaultThreadPool();
+	if (std::max(DrawWorkers(pool, options), ThreadPool::currentWorker() + 1) > options.arena->size()) {
+		throw std::invalid_argument("DrawOptions: frame arena made for a smaller thread pool");
+	}
+}
+
+// Side of the binning tiles for the requested size. Tiles are made of whole blocks, so that each
+// tile of the coarse depth buffer is in one tile.
+inline int BinTileSize(int tileSize) {
+	return (std::max(tileSize, 1) + kBlockSize - 1) / kBlockSize * kBlockSize;
+}
+
+// Square screen tiles, each with the list of the triangles overlapping it in submission order. The
+// lists are stored one after the other, counted first so that the memory is allocated once.
+struct TriangleBins {
+
+	int tileSize;
+	int tilesX;
+	int tilesY;
+	ArenaVector<uint32_t> offsets;	// The list of tile i is [offsets[i], offsets[i + 1]) in triangles
+	ArenaVector<uint32_t> triangles;
+
+	TriangleBins(std::span<const Triangle> tris, int w, int h, int tileSize_, Arena* arena = nullptr) :
+		tileSize(BinTileSize(tileSize_)),
+		tilesX((w + tileSize - 1) / tileSize),
+		tilesY((h + tileSize - 1) / tileSize),
+		offsets(tilesX * tilesY + 1, 0, ArenaAllocator<uint32_t>(arena)),
+		triangles(ArenaAllocator<uint32_t>(arena)) {
+
+		const auto forEachTile = [&](const Triangle& tri, auto&& fn) {
+			for (int ty = tri.bottom / tileSize; ty <= (tri.top - 1) / tileSize; ++ty) {
+				for (int tx = tri.left / tileSize; tx <= (tri.right - 1) / tileSize; ++tx) {
+					fn(ty * tilesX + tx);
+				}
+			}
+		};
+
+		// Sizes of the lists, then their starts
+		for (const Triangle& tri : tris) {
+			if (!tri.empty()) {
+				forEachTile(tri, [&](int tile) { ++offsets[tile + 1]; });
+			}
+		}
+		for (int tile = 0; tile < size(); ++tile) {
+			offsets[tile + 1] += offsets[tile];
+		}
+
+		// Filled with offsets[tile] as the end of the list, which then becomes the start of the next
+		triangles.resize(offsets.back());
+		for (uint32_t i = 0; i < tris.size(); ++i) {
+			if (!tris[i].empty()) {
+				forEachTile(tris[i], [&](int tile) { triangles[offsets[tile]++] = i; });
+			}
+		}
+		for (int tile = size(); tile > 0; --tile) {
+			offsets[tile] = offsets[tile - 1];
+		}
+		offsets[0] = 0;
+	}
+
+	int size() const {
+		return tilesX * tilesY;
+	}
+
+	std::span<const uint32_t> bin(int tile) const {
+		return std::span<const uint32_t>(triangles).subspan(offsets[tile], offsets[tile + 1] - offsets[tile]);
+	}
+
+};
+
+// Each tile keeps the list of the triangles overlapping it, in submission order. Tiles are
+// then rendered in parallel: every worker owns the pixels of its tile, so no locks are needed,
+// and the order of the fragments of each pixel is the same as in the immediate mode.
+template <typename State, typename FB, typename Vert, typename Frag>
+void DrawBinned(FB& framebuffer, std::span<const Vert> verts, std::span<const Triangle> triangles, const Frag& fShader,
+	const DrawOptions& options, DrawStats& stats) {
+
+	StageTimer<IsInstrumented<State>()> timer;
+	Arena* arena = LocalArena(options);
+	const TriangleBins bins(triangles, framebuffer.w, framebuffer.h, options.tileSize, arena);
+	const int tileSize = bins.tileSize;
+	stats.binningMs = timer.lap();
+
+	ThreadPool& pool = options.pool ? *options.pool : DefaultThreadPool();
+
+	// Shaders are not required to be thread safe, so each worker uses its own copy
+	ArenaVector<Frag> shaders(DrawWorkers(pool, options), fShader, ArenaAllocator<Frag>(arena));
+	ArenaVector<CountersOf<State>> counters(shaders.size(), ArenaAllocator<CountersOf<State>>(arena));
+	for (auto& workerCounters : counters) {
+		workerCounters.overdraw = options.overdraw;
+	}
+
+	pool.parallelFor(bins.size(), [&](int tile, int worker) {
+
+		const std::span<const uint32_t> bin = bins.bin(tile);
+		if (bin.empty()) {
+			return;
+		}
+
+		Frag& shader = shaders[worker];
+		const int x0 = (tile % bins.tilesX) * tileSize;
+		const int y0 = (tile / bins.tilesX) * tileSize;
+		const int x1 = std::min(x0 + tileSize, framebuffer.w);
+		const int y1 = std::min(y0 + tileSize, framebuffer.h);
+
+		for (uint32_t i : bin) {
+			DrawTriangleStreaming<State>(framebuffer, shader, verts, triangles[i], x0, y0, x1, y1, counters[worker]);
+		}
+		}, static_cast<int>(shaders.size()));
+
+	stats.rasterMs = timer.lap();
+	for (const auto& workerCounters : counters) {
+		stats.add(workerCounters);
+	}
+}
+
+// Two passes. The visibility pass rasterizes the binned tiles in parallel, only depth testing the
+// fragments and keeping, for each pixel, the triangle and barycentrics of the last fragment passing
+// the test. The shading pass then interpolates and shades each visible pixel once, bands of rows in
+// parallel, so that the shading cost depends on the resolution but not on the overdraw. Without
+// blending, the last fragment passing the test sets the color, so the result is the same as the
+// other modes.
+template <typename State, typename FB, typename Vert, typename Frag>
+void DrawDeferred(FB& framebuffer, std::span<const Vert> verts, std::span<const Triangle> triangles, const Frag& fShader,
+	const DrawOptions& options, DrawStats& stats) {
+
+	if constexpr (State::blend != BlendMode::None || !EarlyDepthTest<Frag>()) {
+		DrawBinned<State>(framebuffer, verts, triangles, fShader, options, stats);
+	}
+	else {
+		constexpr bool derivatives = UsesDerivatives<Frag, FragmentOf<Vert>>::value;
+
+		StageTimer<IsInstrumented<State>()> timer;
+		Arena* arena = LocalArena(options);
+		VisibilityBuffer drawVisibility(arena);
+		VisibilityBuffer& visibility = options.visibility ? *options.visibility : drawVisibility;
+		visibility.resize(framebuffer.w, framebuffer.h);
+
+		const TriangleBins bins(triangles, framebuffer.w, framebuffer.h, options.tileSize, arena);
+		const int tileSize = bins.tileSize;
+		stats.binningMs = timer.lap();
+
+		ThreadPool& pool = options.pool ? *options.pool : DefaultThreadPool();
+		const int workers = DrawWorkers(pool, options);
+		ArenaVector<CountersOf<State>> counters(workers, ArenaAllocator<CountersOf<State>>(arena));
+		for (auto& workerCounters : counters) {
+			workerCounters.overdraw = options.overdraw;
+		}
+
+		// Visibility pass. Only the tiles with triangles are cleared, the others are skipped by
+		// the shading pass.
+		pool.parallelFor(bins.size(), [&](int tile, int worker) {
+
+			const std::span<const uint32_t> bin = bins.bin(tile);
+			if (bin.empty()) {
+				return;
+			}
+
+			const int x0 = (tile % bins.tilesX) * tileSize;
+			const int y0 = (tile / bins.tilesX) * tileSize;
+			const int x1 = std::min(x0 + tileSize, framebuffer.w);
+			const int y1 = std::min(y0 + tileSize, framebuffer.h);
+			visibility.clear(x0, y0, x1, y1);
+
+			for (uint32_t i : bin) {
+				RasterizeFragments<State, Frag>(framebuffer, verts, triangles[i], x0, y0, x1, y1, counters[worker],
+					[&](const RasterBlock&, int px, int py, float z, float wa, float wb, float wc) {
+						if constexpr (State::depthWrite) {
+							framebuffer.setDepth(px, py, z);
+						}
+						visibility.at(px, py) = { i, wa, wb, wc };
+					});
+			}
+			}, workers);
+		stats.rasterMs = timer.lap();
+
+		if constexpr (State::writesColor) {
+
+			// Shading pass, by bands of rows as high as the blocks
+			ArenaVector<Frag> shaders(workers, fShader, ArenaAllocator<Frag>(arena));
+			const int bands = (framebuffer.h + kBlockSize - 1) / kBlockSize;
+
+			pool.parallelFor(bands, [&](int band, int worker) {
+
+				Frag& shader = shaders[worker];
 
-		const int x = static_cast<int>(frag.pos.x);
-		const int y = static_cast<int>(frag.pos.y);
+				// Neighbor pixels mostly belong to the same triangle
+				uint32_t current = VisibilityBuffer::kNoTriangle;
+				std::optional<TriangleAttributes<Vert>> attrs;
 
-		// Z-test
-		const float depth = framebuffer.getDepth(x, y);
-		if (frag.pos.z < depth) {
-			framebuffer.setDepth(x, y, frag.pos.z);
+				for (int py = band * kBlockSize; py < std::min((band + 1) * kBlockSize, framebuffer.h); ++py) {
+					const int ty = py / tileSize;
+					for (int tx = 0; tx < bins.tilesX; ++tx) {
+						if (bins.bin(ty * bins.tilesX + tx).empty()) {
+							continue;
+						}
 
-			// Alpha blending
-			const Vec4& src = framebuffer.getColor(x, y);
-			const Vec4 res = src * (1 - color.a) + color * color.a;
+						for (int px = tx * tileSize; px < std::min((tx + 1) * tileSize, framebuffer.w); ++px) {
+							const VisibilityBuffer::Sample& sample = visibility.at(px, py);
+							if (sample.triangle == VisibilityBuffer::kNoTriangle) {
+								continue;
+							}
 
-			framebuffer.setColor(x, y, res);
+							const Triangle& tri = triangles[sample.triangle];
+							if (sample.triangle != current) {
+								current = sample.triangle;
+								attrs.emplace(verts[tri.a], verts[tri.b], verts[tri.c]);
+							}
+
+							const float z = framebuffer.quantizeDepth(
+								InterpolateDepth(tri, verts[tri.a], verts[tri.b], verts[tri.c], sample.wa, sample.wb, sample.wc));
+							const auto frag = InterpolateFragment(*attrs, px + 0.5f, py + 0.5f, z, sample.wa, sample.wb, sample.wc);
+
+							Vec4 color;
+							if constexpr (derivatives) {
+								constexpr int last = kBlockSize - 1;
+								const RasterBlock block = TriangleBlock(tri, px & ~last, py & ~last);
+								color = ShadeFragment(shader, frag, QuadDerivatives(tri, block, *attrs, (px & last) & ~1, (py & last) & ~1));
+							}
+							else {
+								color = ShadeFragment(shader, frag);
+							}
+							WriteColor<State>(framebuffer, px, py, color);
+							counters[worker].shaded();
+							counters[worker].written();
+						}
+					}
+				}
+				}, workers);
+			stats.shadeMs = timer.lap();
+		}
+
+		for (const auto& workerCounters : counters) {
+			stats.add(workerCounters);
+		}
+	}
+}
+
+// Apply the vertex shader. The position stays in clip space, it is divided by w after clipping
+// (see AssembleTriangles).
+template <typename VertAttr, typename Vert>
+auto ShadeVertex(Vert& vShader, const VertAttr& vertex) {
+	return std::apply(vShader, vertex);		// it works with const Vertex a, but how?
+}
+
+// Number of vertices shaded by a worker at once
+constexpr size_t kVertexBatch = 1024;
+
+// Shade all the input vertices, in parallel batches. Shaders providing shadeBatch() get the whole
+// batch at once, so that they can vectorize it.
+template <typename VertAttr, typename Vert, typename VertOut>
+void ShadeVertices(Vert vShader, std::span<const VertAttr> in, std::span<VertOut> out, const DrawOptions& options) {
+
+	if constexpr (requires { vShader.prepare(); }) {
+		vShader.prepare();
+	}
+
+	ThreadPool& pool = options.pool ? *options.pool : DefaultThreadPool();
+	const int batches = static_cast<int>((in.size() + kVertexBatch - 1) / kVertexBatch);
+
+	// Shaders are not required to be thread safe, so each worker uses its own copy
+	const int workers = std::min(DrawWorkers(pool, options), std::max(batches, 1));
+	ArenaVector<Vert> shaders(workers, vShader, ArenaAllocator<Vert>(LocalArena(options)));
+
+	pool.parallelFor(batches, [&](int batch, int worker) {
+
+		Vert& shader = shaders[worker];
+		const size_t start = batch * kVertexBatch;
+		const size_t count = std::min(kVertexBatch, in.size() - start);
+
+		if constexpr (requires { shader.shadeBatch(in.subspan(start, count), out.subspan(start, count)); }) {
+			shader.shadeBatch(in.subspan(start, count), out.subspan(start, count));
+		}
+		else {
+			for (size_t i = start; i < start + count; ++i) {
+				out[i] = ShadeVertex(shader, in[i]);
+			}
+		}
+		}, workers);
+}
+
+template <typename State, typename FB, typename VertOut, typename Frag>
+void DrawAssembled(FB& framebuffer, std::span<const VertOut> verts, std::span<const Triangle> triangles, Frag& fShader,
+	const DrawOptions& options, DrawStats& stats) {
+
+	if constexpr (FB::samples > 1) {
+		if (options.mode == RasterMode::Immediate || options.mode == RasterMode::Streaming) {
+			DrawStreaming<State>(framebuffer, verts, triangles, fShader, options, stats);
+		}
+		else {
+			DrawBinned<State>(framebuffer, verts, triangles, fShader, options, stats);
+		}
+	}
+	else {
+		switch (options.mode) {
+		case RasterMode::Immediate:
+			DrawImmediate<State>(framebuffer, verts, triangles, fShader, options, stats);
+			break;
+		case RasterMode::Streaming:
+			DrawStreaming<State>(framebuffer, verts, triangles, fShader, options, stats);
+			break;
+		case RasterMode::Binned:
+			DrawBinned<State>(framebuffer, verts, triangles, fShader, options, stats);
+			break;
+		case RasterMode::Deferred:
+			DrawDeferred<State>(framebuffer, verts, triangles, fShader, options, stats);
+			break;
+		}
+	}
+}
+
+// Effective cull mode of a draw
+template <typename State>
+CullMode DrawCullMode(const DrawOptions& options) {
+	return State::cull != CullMode::None ? State::cull : options.cull;
+}
+
+// Draw a list of triangles, each made of three consecutive vertices. State is the fixed function
+// state (see PipelineState), e.g. DrawTriangles<OpaqueState>(...) for opaque geometry. With an
+// Instrumented state, the statistics of the draw are returned (see DrawStats), otherwise they are empty.
+template <typename State = DefaultState, typename FB, typename VertAttr, typename Vert, typename Frag>
+DrawStats DrawTriangles(FB& framebuffer, std::span<VertAttr> vertices, Vert vShader, Frag fShader,
+	const DrawOptions& options = {}) {
+
+	using VertOut = decltype(ShadeVertex(vShader, vertices[0]));
+	constexpr bool instrumented = IsInstrumented<State>();
+
+	CheckDrawArena(options);
+	DrawStats stats;
+	StageTimer<instrumented> timer;
+
+	// Vertex processing
+	Arena* arena = LocalArena(options);
+	ArenaVector<VertOut> verts(vertices.size(), ArenaAllocator<VertOut>(arena));
+	ShadeVertices(vShader, std::span<const VertAttr>(vertices), std::span<VertOut>(verts), options);
+	if constexpr (instrumented) {
+		stats.verticesShaded = verts.size();
+	}
+	stats.vertexMs = timer.lap();
+
+	// Primitive assembly
+	const ArenaVector<Triangle> triangles = AssembleTriangles<FB::samples>(verts, std::views::iota(uint32_t(0), static_cast<uint32_t>(verts.size())),
+		framebuffer.w, framebuffer.h, DrawCullMode<State>(options), options.frontFace, instrumented ? &stats : nullptr, arena);
+	stats.setupMs = timer.lap();
+
+	DrawAssembled<State>(framebuffer, std::span<const VertOut>(verts), std::span<const Triangle>(triangles), fShader, options, stats);
+	if constexpr (instrumented) {
+		stats.pixels = framebuffer.w * framebuffer.h;
+		stats.totalMs = stats.vertexMs + stats.setupMs + timer.lap();
+	}
+	return stats;
+}
+
+// Shade the vertices used by the triangles given by consecutive triples of indices, each only once
+// no matter how many triangles share it. verts gets the shaded vertices and shadedIndices the
+// triangles as indices into verts.
+template <typename VertAttr, typename Vert, typename VertOut, typename VertAlloc, typename IndexAlloc>
+void ShadeIndexedVertices(Vert vShader, std::span<VertAttr> vertices, std::span<const uint32_t> indices,
+	std::vector<VertOut, VertAlloc>& verts, std::vector<uint32_t, IndexAlloc>& shadedIndices, const DrawOptions& options) {
+
+	constexpr uint32_t notShaded = ~uint32_t(0);
+	Arena* arena = LocalArena(options);
+
+	// Post-transform cache that keeps every shaded vertex: cache[i] is the position of the shaded
+	// vertex i in verts. Vertices are shaded in order of first use.
+	ArenaVector<uint32_t> cache(vertices.size(), notShaded, ArenaAllocator<uint32_t>(arena));
+	ArenaVector<uint32_t> used{ ArenaAllocator<uint32_t>(arena) };
+	used.reserve(std::min(vertices.size(), indices.size()));
+	shadedIndices.resize(indices.size() / 3 * 3);
+	for (size_t i = 0; i < shadedIndices.size(); ++i) {
+		const uint32_t index = indices[i];
+		if (index >= vertices.size()) {
+			throw std::out_of_range("ShadeIndexedVertices: vertex index out of range");
 		}
+		if (cache[index] == notShaded) {
+			cache[index] = static_cast<uint32_t>(used.size());
+			used.push_back(index);
+		}
+		shadedIndices[i] = cache[index];
+	}
+
+	// Gathering the used vertices unless they are already all in order
+	verts.resize(used.size());
+	if (used.size() == vertices.size() && (used.empty() || used.back() == used.size() - 1) &&
+		std::ranges::is_sorted(used)) {
+		ShadeVertices(vShader, std::span<const VertAttr>(vertices), std::span<VertOut>(verts), options);
+	}
+	else {
+		using Attr = std::remove_const_t<VertAttr>;
+		ArenaVector<Attr> gathered{ ArenaAllocator<Attr>(arena) };
+		gathered.reserve(used.size());
+		for (uint32_t index : used) {
+			gathered.push_back(vertices[index]);
+		}
+		ShadeVertices(vShader, std::span<const Attr>(gathered), std::span<VertOut>(verts), options);
 	}
-}
\ No newline at end of file
+}
+
+// Draw a list of triangles, each made of three consecutive indices into the vertices. Each vertex is
+// shaded only once, no matter how many triangles share it.
+template <typename State = DefaultState, typename FB, typename VertAttr, typename Vert, typename Frag>
+DrawStats DrawIndexedTriangles(FB& framebuffer, std::span<VertAttr> vertices, std::span<const uint32_t> indices,
+	Vert vShader, Frag fShader, const DrawOptions& options = {}) {
+
+	using VertOut = decltype(ShadeVertex(vShader, vertices[0]));
+	constexpr bool instrumented = IsInstrumented<State>();
+
+	CheckDrawArena(options);
+	DrawStats stats;
+	StageTimer<instrumented> timer;
+
+	// Vertex processing
+	Arena* arena = LocalArena(options);
+	ArenaVector<VertOut> verts{ ArenaAllocator<VertOut>(arena) };
+	ArenaVector<uint32_t> shadedIndices{ ArenaAllocator<uint32_t>(arena) };
+	ShadeIndexedVertices(vShader, vertices, indices, verts, shadedIndices, options);
+	if constexpr (instrumented) {
+		stats.verticesShaded = verts.size();
+	}
+	stats.vertexMs = timer.lap();
+
+	// Primitive assembly
+	const ArenaVector<Triangle> triangles = AssembleTriangles<FB::samples>(verts, shadedIndices, framebuffer.w, framebuffer.h,
+		DrawCullMode<State>(options), options.frontFace, instrumented ? &stats : nullptr, arena);
+	stats.setupMs = timer.lap();
+
+	DrawAssembled<State>(framebuffer, std::span<const VertOut>(verts), std::span<const Triangle>(triangles), fShader, options, stats);
+	if constexpr (instrumented) {
+		stats.pixels = framebuffer.w * framebuffer.h;
+		stats.totalMs = stats.vertexMs + stats.setupMs + timer.lap();
+	}
+	return stats;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Minimal PNG encoder for 8 bit RGB images, with no external dependency. Image data is either
+// stored uncompressed (fastest to write, biggest files) or compressed with a small deflate
+// encoder: rows are filtered with the best of None, Sub and Up, and compressed with LZ77 matches
+// from a hash table and the fixed Huffman codes.
+std::vector<uint8_t> EncodePNG(const uint8_t* rgb, int w, int h, bool compress);
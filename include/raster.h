@@ -0,0 +1,539 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <type_traits>
+
+#include "vec.h"
+#include "simd.h"
+
+// Triangles are rasterized in blocks of 8x8 pixels. Vertices are snapped to 1/16 of pixel and the
+// edge functions are evaluated with integer arithmetic, so that coverage is exact and follows the
+// top-left fill rule: pixels on the edge shared by two triangles are drawn exactly once.
+
+constexpr int kSubpixelBits = 4;
+constexpr int kSubpixelSteps = 1 << kSubpixelBits;
+constexpr int kBlockSize = 8;
+
+// Positions of the samples of multisampled pixels, in subpixel steps from the pixel center: the
+// standard patterns of Direct3D, with y flipped since it points up here
+template <int samples>
+struct SamplePattern;
+
+template <>
+struct SamplePattern<1> {
+	static constexpr int x[1] = { 0 };
+	static constexpr int y[1] = { 0 };
+};
+
+template <>
+struct SamplePattern<4> {
+	static constexpr int x[4] = { -2, 6, -6, 2 };
+	static constexpr int y[4] = { 6, 2, -2, -6 };
+};
+
+template <>
+struct SamplePattern<8> {
+	static constexpr int x[8] = { 1, -1, 5, -3, -5, -7, 3, 7 };
+	static constexpr int y[8] = { 3, -3, -1, 5, -5, 1, -7, 7 };
+};
+
+static_assert(kSubpixelSteps == 16, "Sample patterns are in 1/16 of pixel");
+
+// Largest distance of a sample from the pixel center along x or y, in subpixel steps
+template <int samples>
+constexpr int SampleReach() {
+	int reach = 0;
+	for (int s = 0; s < samples; ++s) {
+		reach = std::max({ reach, std::abs(SamplePattern<samples>::x[s]), std::abs(SamplePattern<samples>::y[s]) });
+	}
+	return reach;
+}
+
+// Window coordinates must be in range [-kMaxFixedCoord, kMaxFixedCoord] for the fixed point setup,
+// so that the edge functions of a block fit in 32 bit lanes
+constexpr float kMaxFixedCoord = 16384.f;
+
+// Triangle ready for rasterization, in window coordinates
+struct Triangle {
+
+	uint32_t a, b, c;		// Indices of the vertices
+	Vec2 aPos, bPos, cPos;
+	float den;				// Twice the signed area
+	bool counterClockwise;	// Winding of the vertices as given, in window space (y up)
+
+	// Pixels covered by the bounding box, right and top are excluded
+	int left, right, bottom, top;
+
+	// Range of the window space depth
+	float zMin, zMax;
+
+	// Edge functions E(px, py) = A * px + B * py + C, evaluated at the center of pixel (px, py).
+	// Edge i is the one opposite to vertex i, E >= 0 inside the triangle (fill rule included).
+	// Vertices are reordered counterclockwise.
+	bool fixedPoint;
+	int32_t edgeA[3];
+	int32_t edgeB[3];
+	int64_t edgeC[3];
+	int32_t edgeBias[3];	// -1 on the edges excluded by the fill rule, already added to C
+	float invArea;			// 1 / sum of the edge functions
+
+	bool empty() const {
+		return left >= right || bottom >= top;
+	}
+
+};
+
+// Transform the vertices (already divided by w) of a triangle to window coordinates. With
+// multisampling, the bounding box keeps the pixels that may have covered samples.
+template <int samples = 1, typename Vert>
+Triangle SetupTriangle(std::span<const Vert> verts, uint32_t ia, uint32_t ib, uint32_t ic, int w, int h) {
+
+	const auto& a = verts[ia];
+	const auto& b = verts[ib];
+	const auto& c = verts[ic];
+
+	Triangle tri;
+	tri.a = ia;
+	tri.b = ib;
+	tri.c = ic;
+
+	// Convert coordinates to window space
+	tri.aPos = { (a.pos.x - -1.f) / 2.f * w, (a.pos.y - -1.f) / 2.f * h };
+	tri.bPos = { (b.pos.x - -1.f) / 2.f * w, (b.pos.y - -1.f) / 2.f * h };
+	tri.cPos = { (c.pos.x - -1.f) / 2.f * w, (c.pos.y - -1.f) / 2.f * h };
+
+	// Bounding box with clipping
+	const float top = std::min((float)h, std::ceil(std::max({ tri.aPos.y, tri.bPos.y, tri.cPos.y })));
+	const float bottom = std::max(0.f, std::floor(std::min({ tri.aPos.y, tri.bPos.y, tri.cPos.y })));
+	const float left = std::max(0.f, std::floor(std::min({ tri.aPos.x, tri.bPos.x, tri.cPos.x })));
+	const float right = std::min((float)w, std::ceil(std::max({ tri.aPos.x, tri.bPos.x, tri.cPos.x })));
+
+	tri.top = static_cast<int>(std::clamp(top, 0.f, (float)h));
+	tri.bottom = static_cast<int>(std::clamp(bottom, 0.f, (float)h));
+	tri.left = static_cast<int>(std::clamp(left, 0.f, (float)w));
+	tri.right = static_cast<int>(std::clamp(right, 0.f, (float)w));
+
+	const float za = a.pos.z / 2.f + 0.5f;
+	const float zb = b.pos.z / 2.f + 0.5f;
+	const float zc = c.pos.z / 2.f + 0.5f;
+	tri.zMin = std::min({ za, zb, zc });
+	tri.zMax = std::max({ za, zb, zc });
+
+	tri.den = (tri.bPos.y - tri.cPos.y) * (tri.aPos.x - tri.cPos.x) + (tri.cPos.x - tri.bPos.x) * (tri.aPos.y - tri.cPos.y);
+	tri.counterClockwise = tri.den > 0.f;
+
+	const auto inRange = [](const Vec2& p) {
+		return std::abs(p.x) <= kMaxFixedCoord && std::abs(p.y) <= kMaxFixedCoord;
+	};
+	tri.fixedPoint = inRange(tri.aPos) && inRange(tri.bPos) && inRange(tri.cPos);
+	if (!tri.fixedPoint) {
+		if (tri.den == 0.f) {
+			tri.right = tri.left;
+		}
+		return tri;
+	}
+
+	// Snap to the subpixel grid
+	const auto snap = [](float v) {
+		return static_cast<int32_t>(std::lround(v * kSubpixelSteps));
+	};
+	int32_t xs[3] = { snap(tri.aPos.x), snap(tri.bPos.x), snap(tri.cPos.x) };
+	int32_t ys[3] = { snap(tri.aPos.y), snap(tri.bPos.y), snap(tri.cPos.y) };
+
+	int64_t area = int64_t(xs[1] - xs[0]) * (ys[2] - ys[0]) - int64_t(ys[1] - ys[0]) * (xs[2] - xs[0]);
+	tri.counterClockwise = area > 0;
+	if (area == 0) {
+		tri.right = tri.left;
+		return tri;
+	}
+
+	// Shrink the bounding box to the pixels whose center (or some sample) is inside the snapped
+	// bounding box, which leaves it empty for small triangles between pixel centers
+	constexpr int32_t half = kSubpixelSteps / 2;
+	constexpr int32_t reach = SampleReach<samples>();
+	const auto firstCenter = [](int32_t v) {	// First pixel with center >= v
+		return -((half - v) >> kSubpixelBits);
+	};
+	const auto lastCenter = [](int32_t v) {		// Last pixel with center <= v
+		return (v - half) >> kSubpixelBits;
+	};
+	tri.left = std::max(tri.left, firstCenter(std::min({ xs[0], xs[1], xs[2] }) - reach));
+	tri.right = std::min(tri.right, lastCenter(std::max({ xs[0], xs[1], xs[2] }) + reach) + 1);
+	tri.bottom = std::max(tri.bottom, firstCenter(std::min({ ys[0], ys[1], ys[2] }) - reach));
+	tri.top = std::min(tri.top, lastCenter(std::max({ ys[0], ys[1], ys[2] }) + reach) + 1);
+	if (tri.empty()) {
+		return tri;
+	}
+	if (area < 0) {
+		std::swap(tri.b, tri.c);
+		std::swap(tri.bPos, tri.cPos);
+		std::swap(xs[1], xs[2]);
+		std::swap(ys[1], ys[2]);
+		tri.den = -tri.den;
+		area = -area;
+	}
+	tri.invArea = 1.f / static_cast<float>(area);
+
+	for (int i = 0; i < 3; ++i) {
+		const int from = (i + 1) % 3;
+		const int to = (i + 2) % 3;
+		const int32_t dx = xs[to] - xs[from];
+		const int32_t dy = ys[to] - ys[from];
+
+		// With y pointing up and counterclockwise order, left edges go down and top edges go left
+		const bool topLeft = dy < 0 || (dy == 0 && dx < 0);
+
+		tri.edgeA[i] = -dy * kSubpixelSteps;
+		tri.edgeB[i] = dx * kSubpixelSteps;
+		tri.edgeBias[i] = topLeft ? 0 : -1;
+		tri.edgeC[i] = int64_t(dx) * (half - ys[from]) - int64_t(dy) * (half - xs[from]) + tri.edgeBias[i];
+	}
+
+	return tri;
+}
+
+// Coverage of the 8x8 block given the edge functions at its first pixel, bit (y * 8 + x) is set for
+// pixel (x, y) of the block. Only called for blocks crossed by some edge, where the edge functions
+// fit 32 bits; the others can be safely saturated.
+inline uint64_t BlockCoverage(const Triangle& tri, const int64_t (&e)[3]) {
+
+	constexpr int64_t limit = int64_t(1) << 30;
+	int32_t e0[3];
+	for (int i = 0; i < 3; ++i) {
+		e0[i] = static_cast<int32_t>(std::clamp(e[i], -limit, limit));
+	}
+
+	uint64_t mask = 0;
+
+#if defined(RASTERIZER_AVX2)
+	const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	__m256i row[3];
+	__m256i stepY[3];
+	for (int i = 0; i < 3; ++i) {
+		row[i] = _mm256_add_epi32(_mm256_set1_epi32(e0[i]), _mm256_mullo_epi32(lane, _mm256_set1_epi32(tri.edgeA[i])));
+		stepY[i] = _mm256_set1_epi32(tri.edgeB[i]);
+	}
+	for (int y = 0; y < kBlockSize; ++y) {
+		// A pixel is inside if no edge function is negative, i.e. the sign bit of their or is 0
+		const __m256i any = _mm256_or_si256(_mm256_or_si256(row[0], row[1]), row[2]);
+		const uint32_t outside = _mm256_movemask_ps(_mm256_castsi256_ps(any));
+		mask |= uint64_t(~outside & 0xff) << (y * kBlockSize);
+		for (int i = 0; i < 3; ++i) {
+			row[i] = _mm256_add_epi32(row[i], stepY[i]);
+		}
+	}
+#elif defined(RASTERIZER_SSE2)
+	__m128i lo[3];
+	__m128i hi[3];
+	__m128i stepY[3];
+	for (int i = 0; i < 3; ++i) {
+		const int32_t a = tri.edgeA[i];
+		lo[i] = _mm_add_epi32(_mm_set1_epi32(e0[i]), _mm_setr_epi32(0, a, 2 * a, 3 * a));
+		hi[i] = _mm_add_epi32(lo[i], _mm_set1_epi32(4 * a));
+		stepY[i] = _mm_set1_epi32(tri.edgeB[i]);
+	}
+	for (int y = 0; y < kBlockSize; ++y) {
+		const __m128i anyLo = _mm_or_si128(_mm_or_si128(lo[0], lo[1]), lo[2]);
+		const __m128i anyHi = _mm_or_si128(_mm_or_si128(hi[0], hi[1]), hi[2]);
+		const uint32_t outside = _mm_movemask_ps(_mm_castsi128_ps(anyLo)) | (_mm_movemask_ps(_mm_castsi128_ps(anyHi)) << 4);
+		mask |= uint64_t(~outside & 0xff) << (y * kBlockSize);
+		for (int i = 0; i < 3; ++i) {
+			lo[i] = _mm_add_epi32(lo[i], stepY[i]);
+			hi[i] = _mm_add_epi32(hi[i], stepY[i]);
+		}
+	}
+#else
+	for (int y = 0; y < kBlockSize; ++y) {
+		int32_t row[3];
+		for (int i = 0; i < 3; ++i) {
+			row[i] = e0[i] + y * tri.edgeB[i];
+		}
+		for (int x = 0; x < kBlockSize; ++x) {
+			if ((row[0] | row[1] | row[2]) >= 0) {
+				mask |= uint64_t(1) << (y * kBlockSize + x);
+			}
+			for (int i = 0; i < 3; ++i) {
+				row[i] += tri.edgeA[i];
+			}
+		}
+	}
+#endif
+
+	return mask;
+}
+
+// Pixels of the 8x8 block at (bx, by) inside the rectangle [x0, x1) x [y0, y1)
+inline uint64_t BlockRectMask(int bx, int by, int x0, int y0, int x1, int y1) {
+
+	const int xLo = std::max(x0 - bx, 0);
+	const int xHi = std::min(x1 - bx, kBlockSize);
+	const int yLo = std::max(y0 - by, 0);
+	const int yHi = std::min(y1 - by, kBlockSize);
+	if (xLo == 0 && yLo == 0 && xHi == kBlockSize && yHi == kBlockSize) {
+		return ~uint64_t(0);
+	}
+
+	const uint64_t row = ((uint64_t(1) << xHi) - 1) & ~((uint64_t(1) << xLo) - 1);
+	uint64_t mask = 0;
+	for (int y = yLo; y < yHi; ++y) {
+		mask |= row << (y * kBlockSize);
+	}
+	return mask;
+}
+
+// Covered pixels of an 8x8 block, bit (y * 8 + x) is set for pixel (x, y) of the block.
+// e are the edge functions at the first pixel of the block.
+struct RasterBlock {
+	int x, y;
+	uint64_t mask;
+	int64_t e[3];
+};
+
+// Block of a multisampled triangle: mask has the pixels with some covered sample, and sampleMasks[s]
+// the pixels whose sample s is covered
+template <int samples>
+struct MultisampleBlock : RasterBlock {
+	uint64_t sampleMasks[samples];
+};
+
+template <int samples>
+using RasterBlockOf = std::conditional_t<samples == 1, RasterBlock, MultisampleBlock<samples>>;
+
+// Barycentric coordinates of a triangle out of the fixed point range, computed from scratch
+inline void FloatBarycentrics(const Triangle& tri, float x, float y, float& wa, float& wb, float& wc) {
+
+	const Vec2& aPos = tri.aPos;
+	const Vec2& bPos = tri.bPos;
+	const Vec2& cPos = tri.cPos;
+	const float den = tri.den;
+
+	wa = ((bPos.y - cPos.y) * (x - cPos.x) + (cPos.x - bPos.x) * (y - cPos.y)) / den;
+	wb = ((cPos.y - aPos.y) * (x - cPos.x) + (aPos.x - cPos.x) * (y - cPos.y)) / den;
+	wc = 1.f - wa - wb;
+}
+
+// Fallback for triangles out of the fixed point range: each pixel of the block is tested separately,
+// at its center moved by (ox, oy) pixels
+inline uint64_t FloatBlockCoverage(const Triangle& tri, int bx, int by, float ox = 0.f, float oy = 0.f) {
+
+	uint64_t mask = 0;
+	for (int dy = 0; dy < kBlockSize; ++dy) {
+		for (int dx = 0; dx < kBlockSize; ++dx) {
+			float wa, wb, wc;
+			FloatBarycentrics(tri, bx + dx + 0.5f + ox, by + dy + 0.5f + oy, wa, wb, wc);
+			constexpr float tol = 0; // 0.00001f;
+			if (wa >= -tol && wb >= -tol && wc >= -tol && wa <= 1 + tol && wb <= 1 + tol && wc <= 1 + tol) {
+				mask |= uint64_t(1) << (dy * kBlockSize + dx);
+			}
+		}
+	}
+	return mask;
+}
+
+// Offsets of the edge functions of the triangle at the samples, from their values at the pixel center
+template <int samples>
+struct SampleEdgeOffsets {
+
+	int32_t offsets[3][samples];
+	int32_t min[3];
+	int32_t max[3];
+
+	explicit SampleEdgeOffsets(const Triangle& tri) {
+		for (int i = 0; i < 3; ++i) {
+			min[i] = 0;
+			max[i] = 0;
+			for (int s = 0; s < samples; ++s) {
+				// The edge coefficients are per pixel, so multiples of kSubpixelSteps
+				offsets[i][s] = (tri.edgeA[i] * SamplePattern<samples>::x[s] + tri.edgeB[i] * SamplePattern<samples>::y[s]) / kSubpixelSteps;
+				min[i] = std::min(min[i], offsets[i][s]);
+				max[i] = std::max(max[i], offsets[i][s]);
+			}
+		}
+	}
+};
+
+// Call blockFn(block) for each 8x8 block with some pixel of the triangle inside the rectangle
+// [x0, x1) x [y0, y1). Blocks for which test(bx, by) returns false are skipped before computing
+// their coverage. With multisampling, blocks are MultisampleBlock with the coverage of each sample.
+template <int samples = 1, typename Test, typename BlockFn>
+void RasterizeBlocks(const Triangle& tri, int x0, int y0, int x1, int y1, Test&& test, BlockFn&& blockFn) {
+
+	x0 = std::max(x0, tri.left);
+	x1 = std::min(x1, tri.right);
+	y0 = std::max(y0, tri.bottom);
+	y1 = std::min(y1, tri.top);
+	if (x0 >= x1 || y0 >= y1) {
+		return;
+	}
+
+	constexpr int last = kBlockSize - 1;
+
+	[[maybe_unused]] std::optional<SampleEdgeOffsets<samples>> sampleEdges;
+	if constexpr (samples > 1) {
+		if (tri.fixedPoint) {
+			sampleEdges.emplace(tri);
+		}
+	}
+
+	for (int by = y0 & ~last; by < y1; by += kBlockSize) {
+		for (int bx = x0 & ~last; bx < x1; bx += kBlockSize) {
+
+			RasterBlockOf<samples> block{};
+			block.x = bx;
+			block.y = by;
+
+			if (!tri.fixedPoint) {
+				if (!test(bx, by)) {
+					continue;
+				}
+				if constexpr (samples == 1) {
+					block.mask = FloatBlockCoverage(tri, bx, by);
+				}
+				else {
+					block.mask = 0;
+					for (int s = 0; s < samples; ++s) {
+						block.sampleMasks[s] = FloatBlockCoverage(tri, bx, by,
+							float(SamplePattern<samples>::x[s]) / kSubpixelSteps, float(SamplePattern<samples>::y[s]) / kSubpixelSteps);
+						block.mask |= block.sampleMasks[s];
+					}
+				}
+			}
+			else {
+				// Edge functions at the first pixel of the block, and their range over the block
+				bool reject = false;
+				bool accept = true;
+				for (int i = 0; i < 3; ++i) {
+					block.e[i] = tri.edgeC[i] + int64_t(tri.edgeA[i]) * bx + int64_t(tri.edgeB[i]) * by;
+					const int64_t stepX = int64_t(tri.edgeA[i]) * last;
+					const int64_t stepY = int64_t(tri.edgeB[i]) * last;
+					int64_t eMax = block.e[i] + std::max<int64_t>(stepX, 0) + std::max<int64_t>(stepY, 0);
+					int64_t eMin = block.e[i] + std::min<int64_t>(stepX, 0) + std::min<int64_t>(stepY, 0);
+					if constexpr (samples > 1) {
+						eMax += sampleEdges->max[i];
+						eMin += sampleEdges->min[i];
+					}
+					reject |= eMax < 0;
+					accept &= eMin >= 0;
+				}
+				if (reject || !test(bx, by)) {
+					continue;
+				}
+				if constexpr (samples == 1) {
+					block.mask = accept ? ~uint64_t(0) : BlockCoverage(tri, block.e);
+				}
+				else {
+					block.mask = 0;
+					for (int s = 0; s < samples; ++s) {
+						const int64_t e[3] = {
+							block.e[0] + sampleEdges->offsets[0][s],
+							block.e[1] + sampleEdges->offsets[1][s],
+							block.e[2] + sampleEdges->offsets[2][s],
+						};
+						block.sampleMasks[s] = accept ? ~uint64_t(0) : BlockCoverage(tri, e);
+						block.mask |= block.sampleMasks[s];
+					}
+				}
+			}
+
+			const uint64_t rect = BlockRectMask(bx, by, x0, y0, x1, y1);
+			block.mask &= rect;
+			if constexpr (samples > 1) {
+				for (int s = 0; s < samples; ++s) {
+					block.sampleMasks[s] &= rect;
+				}
+			}
+			if (block.mask != 0) {
+				blockFn(block);
+			}
+		}
+	}
+}
+
+// Block at (bx, by) with the edge functions of the triangle, whether it covers the block or not
+inline RasterBlock TriangleBlock(const Triangle& tri, int bx, int by) {
+	RasterBlock block{ bx, by, 0, {} };
+	if (tri.fixedPoint) {
+		for (int i = 0; i < 3; ++i) {
+			block.e[i] = tri.edgeC[i] + int64_t(tri.edgeA[i]) * bx + int64_t(tri.edgeB[i]) * by;
+		}
+	}
+	return block;
+}
+
+// Barycentric coordinates at the center of pixel (dx, dy) of the block. The pixel does not need
+// to be covered, e.g. the other pixels of a 2x2 quad when computing derivatives.
+inline void BlockBarycentrics(const Triangle& tri, const RasterBlock& block, int dx, int dy, float& wa, float& wb, float& wc) {
+	if (tri.fixedPoint) {
+		const int64_t* e = block.e;
+		wa = (e[0] - tri.edgeBias[0] + int64_t(tri.edgeA[0]) * dx + int64_t(tri.edgeB[0]) * dy) * tri.invArea;
+		wb = (e[1] - tri.edgeBias[1] + int64_t(tri.edgeA[1]) * dx + int64_t(tri.edgeB[1]) * dy) * tri.invArea;
+		wc = (e[2] - tri.edgeBias[2] + int64_t(tri.edgeA[2]) * dx + int64_t(tri.edgeB[2]) * dy) * tri.invArea;
+	}
+	else {
+		FloatBarycentrics(tri, block.x + dx + 0.5f, block.y + dy + 0.5f, wa, wb, wc);
+	}
+}
+
+// Offsets of the barycentric coordinates at the samples of a pixel from the ones at its center,
+// the same for every pixel of the triangle
+template <int samples>
+struct SampleBarycentrics {
+
+	float wa[samples], wb[samples], wc[samples];
+
+	explicit SampleBarycentrics(const Triangle& tri) {
+		if (tri.fixedPoint) {
+			const SampleEdgeOffsets<samples> edges(tri);
+			for (int s = 0; s < samples; ++s) {
+				wa[s] = edges.offsets[0][s] * tri.invArea;
+				wb[s] = edges.offsets[1][s] * tri.invArea;
+				wc[s] = edges.offsets[2][s] * tri.invArea;
+			}
+		}
+		else {
+			const float x = tri.left + 0.5f;
+			const float y = tri.bottom + 0.5f;
+			float a, b, c;
+			FloatBarycentrics(tri, x, y, a, b, c);
+			for (int s = 0; s < samples; ++s) {
+				FloatBarycentrics(tri, x + float(SamplePattern<samples>::x[s]) / kSubpixelSteps, y + float(SamplePattern<samples>::y[s]) / kSubpixelSteps,
+					wa[s], wb[s], wc[s]);
+				wa[s] -= a;
+				wb[s] -= b;
+				wc[s] -= c;
+			}
+		}
+	}
+};
+
+// Call fn(x, y, wa, wb, wc) for each covered pixel of the block, where (x, y) is the pixel center
+// and wa, wb, wc are the barycentric coordinates
+template <typename Fn>
+void ForEachPixel(const Triangle& tri, const RasterBlock& block, Fn&& fn) {
+
+	for (uint64_t mask = block.mask; mask != 0; mask &= mask - 1) {
+		const int bit = std::countr_zero(mask);
+		const int dx = bit % kBlockSize;
+		const int dy = bit / kBlockSize;
+		const float x = block.x + dx + 0.5f;
+		const float y = block.y + dy + 0.5f;
+
+		float wa, wb, wc;
+		BlockBarycentrics(tri, block, dx, dy, wa, wb, wc);
+
+		fn(x, y, wa, wb, wc);
+	}
+}
+
+// Call fn(x, y, wa, wb, wc) for each pixel of the triangle inside the rectangle [x0, x1) x [y0, y1)
+template <typename Fn>
+void RasterizeTriangle(const Triangle& tri, int x0, int y0, int x1, int y1, Fn&& fn) {
+	RasterizeBlocks(tri, x0, y0, x1, y1, [](int, int) { return true; }, [&](const RasterBlock& block) {
+		ForEachPixel(tri, block, fn);
+		});
+}
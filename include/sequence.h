@@ -0,0 +1,216 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+// Rendering of sequences of frames: each frame is rendered in a framebuffer from a pool while the
+// previous frames are written by an output thread, so that I/O overlaps with rendering.
+
+// Fixed set of framebuffers allocated once and reused for all the frames of a sequence.
+// acquire() blocks until a framebuffer is released.
+template <typename FB>
+class FramebufferPool {
+
+public:
+
+	FramebufferPool(int w, int h, int count = 2) {
+		for (int i = 0; i < std::max(count, 1); ++i) {
+			framebuffers.push_back(std::make_unique<FB>(w, h));
+			available.push_back(framebuffers.back().get());
+		}
+	}
+
+	FramebufferPool(const FramebufferPool&) = delete;
+	FramebufferPool& operator=(const FramebufferPool&) = delete;
+
+	int size() const {
+		return static_cast<int>(framebuffers.size());
+	}
+
+	FB& acquire() {
+		std::unique_lock lock(mutex);
+		cond.wait(lock, [&] { return !available.empty(); });
+		FB* res = available.back();
+		available.pop_back();
+		return *res;
+	}
+
+	void release(FB& framebuffer) {
+		{
+			std::lock_guard lock(mutex);
+			available.push_back(&framebuffer);
+		}
+		cond.notify_one();
+	}
+
+private:
+
+	std::vector<std::unique_ptr<FB>> framebuffers;
+	std::vector<FB*> available;
+	std::mutex mutex;
+	std::condition_variable cond;
+
+};
+
+// Timings of a frame, in milliseconds
+struct FrameStats {
+	double waitMs = 0.;		// Waiting for a free framebuffer, i.e. for the output of older frames
+	double renderMs = 0.;
+	double outputMs = 0.;
+};
+
+struct SequenceStats {
+
+	std::vector<FrameStats> frames;
+	double totalMs = 0.;
+
+	double framesPerSecond() const {
+		return totalMs > 0. ? frames.size() * 1000. / totalMs : 0.;
+	}
+
+	// Average and max of a field over the frames
+	double average(double FrameStats::* field) const {
+		double sum = 0.;
+		for (const FrameStats& frame : frames) {
+			sum += frame.*field;
+		}
+		return frames.empty() ? 0. : sum / frames.size();
+	}
+
+	double max(double FrameStats::* field) const {
+		double res = 0.;
+		for (const FrameStats& frame : frames) {
+			res = std::max(res, frame.*field);
+		}
+		return res;
+	}
+
+	void print(std::ostream& os) const {
+		os << frames.size() << " frames in " << totalMs << " ms (" << framesPerSecond() << " fps)\n";
+		os << "  render: avg " << average(&FrameStats::renderMs) << " ms, max " << max(&FrameStats::renderMs) << " ms\n";
+		os << "  output: avg " << average(&FrameStats::outputMs) << " ms, max " << max(&FrameStats::outputMs) << " ms\n";
+		os << "  wait:   avg " << average(&FrameStats::waitMs) << " ms, max " << max(&FrameStats::waitMs) << " ms\n";
+	}
+
+};
+
+// Render frameCount frames. render(frame, framebuffer) runs on the calling thread: it updates the
+// uniforms of the shaders for the frame (e.g. the model matrix of CubeVertShader), clears the
+// framebuffer and draws. output(frame, framebuffer) then runs on a separate thread, while the next
+// frames are rendered in the other framebuffers of the pool. It should not use the default thread
+// pool, which is busy rendering (see ToImage). Exceptions of output stop the sequence and are
+// rethrown.
+template <typename FB, typename RenderFn, typename OutputFn>
+SequenceStats RenderSequence(FramebufferPool<FB>& pool, int frameCount, RenderFn&& render, OutputFn&& output) {
+
+	using Clock = std::chrono::steady_clock;
+	const auto elapsedMs = [](Clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	};
+
+	SequenceStats stats;
+	stats.frames.resize(std::max(frameCount, 0));
+	const Clock::time_point sequenceStart = Clock::now();
+
+	struct Rendered {
+		int frame;
+		FB* framebuffer;
+	};
+
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::deque<Rendered> queue;
+	bool done = false;
+	std::exception_ptr error;
+
+	// Each frame's outputMs is only written by this thread, the other fields by the calling thread
+	std::thread outputThread([&] {
+		while (true) {
+			Rendered rendered;
+			{
+				std::unique_lock lock(mutex);
+				cond.wait(lock, [&] { return !queue.empty() || done; });
+				if (queue.empty()) {
+					return;
+				}
+				rendered = queue.front();
+				queue.pop_front();
+			}
+
+			const Clock::time_point start = Clock::now();
+			try {
+				output(rendered.frame, static_cast<const FB&>(*rendered.framebuffer));
+			}
+			catch (...) {
+				std::lock_guard lock(mutex);
+				if (!error) {
+					error = std::current_exception();
+				}
+			}
+			stats.frames[rendered.frame].outputMs = elapsedMs(start);
+			pool.release(*rendered.framebuffer);
+		}
+		});
+
+	// The output thread must be joined even if render throws
+	std::exception_ptr renderError;
+	try {
+		for (int frame = 0; frame < frameCount; ++frame) {
+			{
+				std::lock_guard lock(mutex);
+				if (error) {
+					break;
+				}
+			}
+
+			Clock::time_point start = Clock::now();
+			FB& framebuffer = pool.acquire();
+			stats.frames[frame].waitMs = elapsedMs(start);
+
+			start = Clock::now();
+			try {
+				render(frame, framebuffer);
+			}
+			catch (...) {
+				pool.release(framebuffer);
+				throw;
+			}
+			stats.frames[frame].renderMs = elapsedMs(start);
+
+			{
+				std::lock_guard lock(mutex);
+				queue.push_back({ frame, &framebuffer });
+			}
+			cond.notify_one();
+		}
+	}
+	catch (...) {
+		renderError = std::current_exception();
+	}
+
+	{
+		std::lock_guard lock(mutex);
+		done = true;
+	}
+	cond.notify_one();
+	outputThread.join();
+
+	if (renderError) {
+		std::rethrow_exception(renderError);
+	}
+
+	stats.totalMs = elapsedMs(sequenceStart);
+
+	if (error) {
+		std::rethrow_exception(error);
+	}
+	return stats;
+}
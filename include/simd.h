@@ -0,0 +1,23 @@
+#pragma once
+
+// Instruction sets enabled at compile time. Code using them must always provide a scalar fallback.
+
+#if defined(__AVX2__)
+#define RASTERIZER_AVX2
+#endif
+
+#if defined(__AVX__)
+#define RASTERIZER_AVX
+#endif
+
+#if defined(__F16C__)
+#define RASTERIZER_F16C
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RASTERIZER_SSE2
+#endif
+
+#if defined(RASTERIZER_SSE2)
+#include <immintrin.h>
+#endif
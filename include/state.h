@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstdint>
+
+#include "vec.h"
+#include "clip.h"
+
+// Fixed function state of a draw, given as a template parameter of DrawTriangles so that each
+// combination is compiled into its own loops, without the stages it does not use.
+
+// Comparison of the fragment depth with the stored depth, the fragment is drawn if it is true
+enum class DepthFunc {
+	Less,
+	LessEqual,
+	Greater,
+	GreaterEqual,
+	Equal,
+	Always,		// No depth test, the stored depths are not read
+};
+
+enum class BlendMode {
+	None,		// Overwrite the stored color, which is not read
+	Alpha,		// dst * (1 - src.a) + src * src.a
+	Additive,	// dst + src * src.a
+};
+
+// Channels written to the framebuffer
+enum ColorMask : uint32_t {
+	kColorMaskR = 1 << 0,
+	kColorMaskG = 1 << 1,
+	kColorMaskB = 1 << 2,
+	kColorMaskA = 1 << 3,
+	kColorMaskRGB = kColorMaskR | kColorMaskG | kColorMaskB,
+	kColorMaskAll = kColorMaskRGB | kColorMaskA,
+};
+
+template <DepthFunc depthFunc_ = DepthFunc::Less, bool depthWrite_ = true, BlendMode blend_ = BlendMode::Alpha,
+	uint32_t colorMask_ = kColorMaskAll, CullMode cull_ = CullMode::None>
+struct PipelineState {
+
+	static constexpr DepthFunc depthFunc = depthFunc_;
+	static constexpr bool depthWrite = depthWrite_;
+	static constexpr BlendMode blend = blend_;
+	static constexpr uint32_t colorMask = colorMask_;
+
+	// Overrides DrawOptions::cull unless None
+	static constexpr CullMode cull = cull_;
+
+	static constexpr bool writesColor = colorMask != 0;
+
+	// The stored color is needed to blend or to keep the masked channels
+	static constexpr bool readsColor = writesColor && (blend != BlendMode::None || colorMask != kColorMaskAll);
+
+};
+
+// Depth test and alpha blending, the behavior of the pipeline without an explicit state
+using DefaultState = PipelineState<>;
+
+// Opaque geometry: the color is overwritten without reading the framebuffer
+using OpaqueState = PipelineState<DepthFunc::Less, true, BlendMode::None>;
+
+// Depth prepass: only depths are written, fragments are still shaded
+using DepthOnlyState = PipelineState<DepthFunc::Less, true, BlendMode::None, 0>;
+
+template <typename State>
+constexpr bool DepthTest(float z, float depth) {
+	if constexpr (State::depthFunc == DepthFunc::Less) {
+		return z < depth;
+	}
+	else if constexpr (State::depthFunc == DepthFunc::LessEqual) {
+		return z <= depth;
+	}
+	else if constexpr (State::depthFunc == DepthFunc::Greater) {
+		return z > depth;
+	}
+	else if constexpr (State::depthFunc == DepthFunc::GreaterEqual) {
+		return z >= depth;
+	}
+	else if constexpr (State::depthFunc == DepthFunc::Equal) {
+		return z == depth;
+	}
+	else {
+		return true;
+	}
+}
+
+// Some fragment of a triangle with quantized depths in [zMin, zMax] may pass the test against a
+// tile with depths in [tileMin, tileMax]
+template <typename State>
+constexpr bool DepthRangeMayPass(float zMin, float zMax, float tileMin, float tileMax) {
+	switch (State::depthFunc) {
+	case DepthFunc::Less: return zMin < tileMax;
+	case DepthFunc::LessEqual: return zMin <= tileMax;
+	case DepthFunc::Greater: return zMax > tileMin;
+	case DepthFunc::GreaterEqual: return zMax >= tileMin;
+	case DepthFunc::Equal: return zMin <= tileMax && zMax >= tileMin;
+	case DepthFunc::Always:
+	default: return true;
+	}
+}
+
+// All the fragments pass the test
+template <typename State>
+constexpr bool DepthRangeAlwaysPasses(float zMin, float zMax, float tileMin, float tileMax) {
+	switch (State::depthFunc) {
+	case DepthFunc::Less: return zMax < tileMin;
+	case DepthFunc::LessEqual: return zMax <= tileMin;
+	case DepthFunc::Greater: return zMin > tileMax;
+	case DepthFunc::GreaterEqual: return zMin >= tileMax;
+	case DepthFunc::Equal: return false;
+	case DepthFunc::Always:
+	default: return true;
+	}
+}
+
+// After a triangle covering a whole tile is drawn, no pixel of the tile is farther than the
+// triangle: either the fragment was written, or the stored depth was nearer
+template <typename State>
+constexpr bool CoveringTriangleBoundsTileMax() {
+	return State::depthWrite &&
+		(State::depthFunc == DepthFunc::Less || State::depthFunc == DepthFunc::LessEqual || State::depthFunc == DepthFunc::Always);
+}
+
+// The result of draws with this state does not depend on their order, up to fragments at equal
+// depths: each pixel gets the nearest fragment, which overwrites the whole color. Such draws may be
+// reordered, e.g. front to back (see CommandList). Depth-only and masked draws leave some channels
+// of the nearest fragment to the draws before them, so they are not.
+template <typename State>
+constexpr bool OrderIndependent() {
+	return State::blend == BlendMode::None && State::depthWrite && State::colorMask == kColorMaskAll &&
+		(State::depthFunc == DepthFunc::Less || State::depthFunc == DepthFunc::LessEqual);
+}
+
+// Blend the fragment color src with the stored color dst, keeping the masked channels of dst
+template <typename State>
+Vec4 BlendColor(const Vec4& dst, const Vec4& src) {
+
+	Vec4 res;
+	if constexpr (State::blend == BlendMode::Alpha) {
+		res = dst * (1 - src.a) + src * src.a;
+	}
+	else if constexpr (State::blend == BlendMode::Additive) {
+		res = dst + src * src.a;
+	}
+	else {
+		res = src;
+	}
+
+	if constexpr (State::colorMask != kColorMaskAll) {
+		for (int i = 0; i < 4; ++i) {
+			if (!(State::colorMask & (1u << i))) {
+				res[i] = dst[i];
+			}
+		}
+	}
+	return res;
+}
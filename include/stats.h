@@ -0,0 +1,171 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include "framebuffer.h"
+
+// Opt-in instrumentation of the draws. It is enabled by wrapping the pipeline state, e.g.
+// DrawTriangles<Instrumented<OpaqueState>>(...), and compiled out otherwise: the counters and the
+// clocks of other states are empty functions.
+
+template <typename State>
+struct Instrumented : State {
+	static constexpr bool instrumented = true;
+};
+
+template <typename State>
+constexpr bool IsInstrumented() {
+	if constexpr (requires { State::instrumented; }) {
+		return State::instrumented;
+	}
+	else {
+		return false;
+	}
+}
+
+// Number of fragments generated for each pixel by the instrumented draws it is given to (see
+// DrawOptions::overdraw), accumulated until clear()
+struct OverdrawMap {
+
+	const int w;
+	const int h;
+	std::vector<uint32_t> counts;
+
+	OverdrawMap(int w_, int h_) : w(w_), h(h_), counts(size_t(w) * h) {}
+
+	void clear() {
+		std::fill(counts.begin(), counts.end(), 0);
+	}
+
+	void add(int x, int y) {
+		++counts[size_t(y) * w + x];
+	}
+
+	uint32_t max() const;
+
+	// Colors for WriteImg: black where no fragment was generated, then from blue for one fragment to
+	// red for maxCount or more (by default the largest count)
+	Framebuffer heatmap(uint32_t maxCount = 0) const;
+
+};
+
+// Fragment counters of a worker, added to the DrawStats at the end of the draw. They do nothing
+// unless enabled.
+template <bool enabled>
+struct alignas(64) DrawCounters {	// Each worker has its own cache line
+
+	uint64_t fragmentsGenerated = 0;
+	uint64_t fragmentsShaded = 0;
+	uint64_t depthPassed = 0;
+	uint64_t depthFailed = 0;
+	uint64_t pixelsWritten = 0;
+
+	OverdrawMap* overdraw = nullptr;
+
+	void generated(int x, int y) {
+		if constexpr (enabled) {
+			++fragmentsGenerated;
+			if (overdraw) {
+				overdraw->add(x, y);
+			}
+		}
+	}
+
+	void shaded() {
+		if constexpr (enabled) {
+			++fragmentsShaded;
+		}
+	}
+
+	void depthTest(bool passed) {
+		if constexpr (enabled) {
+			++(passed ? depthPassed : depthFailed);
+		}
+	}
+
+	void written() {
+		if constexpr (enabled) {
+			++pixelsWritten;
+		}
+	}
+
+};
+
+// Statistics of an instrumented draw, returned by the draw call
+struct DrawStats {
+
+	uint64_t verticesShaded = 0;
+
+	uint64_t trianglesSubmitted = 0;
+	uint64_t trianglesOutside = 0;		// Entirely outside the view frustum
+	uint64_t trianglesClipped = 0;		// Crossing the near or far plane or the guard band
+	uint64_t trianglesCulled = 0;		// Facing the culled side
+	uint64_t trianglesEmpty = 0;		// Covering no pixel center
+	uint64_t trianglesRasterized = 0;	// After clipping, so possibly more than submitted
+
+	uint64_t fragmentsGenerated = 0;	// Covered pixels of the blocks that passed the coarse depth test
+	uint64_t fragmentsShaded = 0;
+	uint64_t depthPassed = 0;
+	uint64_t depthFailed = 0;
+	uint64_t pixelsWritten = 0;			// Fragments written to the framebuffer, blended or not
+
+	int pixels = 0;		// Of the framebuffer
+
+	// Stages, in milliseconds. The streaming and binned modes shade and blend while rasterizing, all
+	// their fragment work is in rasterMs.
+	double vertexMs = 0.;
+	double setupMs = 0.;		// Clipping, culling and triangle setup
+	double binningMs = 0.;
+	double rasterMs = 0.;		// The visibility pass in the deferred mode
+	double shadeMs = 0.;
+	double totalMs = 0.;
+
+	// Fragments generated per pixel of the framebuffer
+	double overdraw() const {
+		return pixels > 0 ? double(fragmentsGenerated) / pixels : 0.;
+	}
+
+	void add(const DrawCounters<true>& counters) {
+		fragmentsGenerated += counters.fragmentsGenerated;
+		fragmentsShaded += counters.fragmentsShaded;
+		depthPassed += counters.depthPassed;
+		depthFailed += counters.depthFailed;
+		pixelsWritten += counters.pixelsWritten;
+	}
+
+	void add(const DrawCounters<false>&) {}
+
+	// Counts and times of another draw, e.g. of a command list
+	void add(const DrawStats& other);
+
+	void print(std::ostream& os) const;
+
+};
+
+// Times the stages of instrumented draws: lap() returns the milliseconds since the previous lap.
+// The clock is only read between stages.
+template <bool enabled>
+struct StageTimer {
+
+	using Clock = std::chrono::steady_clock;
+
+	Clock::time_point start = Clock::now();
+
+	double lap() {
+		const Clock::time_point now = Clock::now();
+		const double ms = std::chrono::duration<double, std::milli>(now - start).count();
+		start = now;
+		return ms;
+	}
+
+};
+
+template <>
+struct StageTimer<false> {
+	double lap() {
+		return 0.;
+	}
+};
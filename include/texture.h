@@ -1,64 +1,214 @@
 #pragma once
 
+#include <array>
 #include <vector>
 #include <string>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
 
 #include "vec.h"
 
+enum class TextureFilter {
+    Nearest,    // Nearest texel of the nearest mip level
+    Bilinear,   // Bilinear interpolation in the nearest mip level
+    Trilinear,  // Bilinear interpolation in the two nearest mip levels, blended
+};
+
+// Storage format of the texels. 8 bit formats store gamma encoded colors, decoded to linear
+// when sampled.
+enum class TextureFormat {
+    RGB32F,     // 12 bytes per texel, linear colors
+    RGBA8,      // 4 bytes per texel
+    BC1,        // 4x4 blocks of 8 bytes (half a byte per texel): two RGB565 endpoints and 2 bit indices
+};
+
+// 4x4 block of BC1 (DXT1) compressed texels
+struct BC1Block {
+    uint16_t color0;
+    uint16_t color1;
+    uint32_t indices;   // 2 bits per texel, texel (x, y) of the block at bit 2 * (y * 4 + x)
+};
+
+// Color of the palette entry of a BC1 block, as 8 bit channels
+inline std::array<uint8_t, 3> DecodeBC1(const BC1Block& block, int index) {
+
+    const auto expand = [](uint16_t c) {
+        const int r = c >> 11;
+        const int g = (c >> 5) & 0x3f;
+        const int b = c & 0x1f;
+        return std::array<int, 3>{ (r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2) };
+    };
+
+    const auto c0 = expand(block.color0);
+    const auto c1 = expand(block.color1);
+
+    // Weights of the endpoints and reciprocal of their sum (as a 17 bit fixed point multiplier):
+    // color0 > color1 means four colors, otherwise three colors and black
+    static constexpr int weights[2][4][3] = {
+        { { 2, 0, 0x10000 }, { 0, 2, 0x10000 }, { 1, 1, 0x10000 }, { 0, 0, 0x10000 } },
+        { { 3, 0, 0xaaab }, { 0, 3, 0xaaab }, { 2, 1, 0xaaab }, { 1, 2, 0xaaab } },
+    };
+    const int (&weight)[3] = weights[block.color0 > block.color1][index];
+
+    std::array<uint8_t, 3> res;
+    for (int i = 0; i < 3; ++i) {
+        res[i] = static_cast<uint8_t>(((weight[0] * c0[i] + weight[1] * c1[i]) * weight[2]) >> 17);
+    }
+    return res;
+}
+
+// Texels are stored in tiles of 4x4 texels (one BC1 block), so that the 2x2 texels of a bilinear
+// footprint are usually in the same tile: 64 bytes, a single cache line, for RGBA8
+constexpr int kTexelTileSize = 4;
+
+// Single level of the mip chain. Only the vector of the texture format is used.
+struct MipLevel {
+
+    int w;
+    int h;
+    int tilesX;
+
+    std::vector<Vec3> texelsRGB32F;
+    std::vector<std::array<uint8_t, 4>> texelsRGBA8;
+    std::vector<BC1Block> blocksBC1;
+
+    MipLevel(int w_, int h_) : w(w_), h(h_), tilesX((w_ + kTexelTileSize - 1) / kTexelTileSize) {}
+
+    int tileIndex(int x, int y) const {
+        return (y / kTexelTileSize) * tilesX + x / kTexelTileSize;
+    }
+
+    int texelIndex(int x, int y) const {
+        return tileIndex(x, y) * kTexelTileSize * kTexelTileSize + (y % kTexelTileSize) * kTexelTileSize + x % kTexelTileSize;
+    }
+
+};
+
+// Immutable once built, so a texture can be shared by many threads and shaders
+// (e.g. through a std::shared_ptr<const Texture>).
 struct Texture {
 
     const int w;
     const int h;
-    std::vector<Vec3> colors;
+    const TextureFormat format;
 
-    Texture(int w_, int h_) : w(w_), h(h_), colors(w* h) {};
+    // levels[0] is the full resolution image, each following level halves the size
+    std::vector<MipLevel> levels;
 
-private:
-    const Vec3& getColor(int x, int y) const {
-        // Repeat the border indefinitely
+    TextureFilter filter = TextureFilter::Trilinear;
 
-        if (x < 0) {
-            x = 0;
-        }
-        else if (x >= w) {
-            x = w - 1;
-        }
-        if (y < 0) {
-            y = 0;
-        }
-        else if (y >= h) {
-            y = h - 1;
+    // Build a texture and its mip chain from linear colors, in row-major order. gamma is the
+    // encoding used by 8 bit formats.
+    Texture(int w_, int h_, std::vector<Vec3> colors, TextureFormat format_ = TextureFormat::RGB32F, float gamma = 2.2f);
+
+    // Level of detail given the screen space derivatives of the texture coordinates
+    float lod(const Vec2& dx, const Vec2& dy) const {
+        const float lenX = norm(Vec2{ dx.x * w, dx.y * h });
+        const float lenY = norm(Vec2{ dy.x * w, dy.y * h });
+        return std::log2(std::max({ lenX, lenY, 1e-8f }));
+    }
+
+    // Sample the given level of detail
+    Vec3 sample(float x, float y, float lod) const {
+
+        lod = std::clamp(lod, 0.f, static_cast<float>(levels.size() - 1));
+
+        switch (filter) {
+        case TextureFilter::Nearest:
+            return sampleLevel(static_cast<int>(lod + 0.5f), x, y, false);
+        case TextureFilter::Bilinear:
+            return sampleLevel(static_cast<int>(lod + 0.5f), x, y, true);
+        case TextureFilter::Trilinear:
+        default:
+            const int level = static_cast<int>(lod);
+            const float t = lod - level;
+            if (t == 0.f) {
+                return sampleLevel(level, x, y, true);
+            }
+            return sampleLevel(level, x, y, true) * (1.f - t) + sampleLevel(level + 1, x, y, true) * t;
         }
+    }
+
+    // Sample the full resolution level
+    Vec3 sample(float x, float y) const {
+        return sample(x, y, 0.f);
+    }
+
+    // Sample with the level of detail given by the screen space derivatives of the coordinates
+    Vec3 sample(const Vec2& tex, const Vec2& dx, const Vec2& dy) const {
+        return sample(tex.x, tex.y, lod(dx, dy));
+    }
+
+private:
 
-        return colors[y * w + x];
+    // Decoding of the 8 bit channels to linear
+    std::array<float, 256> toLinear;
+
+    Vec3 sampleLevel(int level, float x, float y, bool bilinear) const {
+        switch (format) {
+        case TextureFormat::RGBA8:
+            return sampleLevel<TextureFormat::RGBA8>(levels[level], x, y, bilinear);
+        case TextureFormat::BC1:
+            return sampleLevel<TextureFormat::BC1>(levels[level], x, y, bilinear);
+        case TextureFormat::RGB32F:
+        default:
+            return sampleLevel<TextureFormat::RGB32F>(levels[level], x, y, bilinear);
+        }
     }
 
-public:
-    Vec3 sample(float x, float y) {
+    template <TextureFormat Format>
+    Vec3 sampleLevel(const MipLevel& level, float x, float y, bool bilinear) const {
 
         // Convert coords from range [0, 1] to [0, w] and [0, h]
-        x *= w;
-        y *= h;
+        x *= level.w;
+        y *= level.h;
+
+        if (!bilinear) {
+            return getColor<Format>(level, static_cast<int>(std::floor(x)), static_cast<int>(std::floor(y)));
+        }
 
         x -= 0.5f;
         y -= 0.5f;
 
-        const int xMin = static_cast<int>(x);
+        const int xMin = static_cast<int>(std::floor(x));
         const int xMax = xMin + 1;
-        const int yMin = static_cast<int>(y);
+        const int yMin = static_cast<int>(std::floor(y));
         const int yMax = yMin + 1;
 
         const float xA = x - xMin;
         const float yA = y - yMin;
 
         return
-            getColor(xMin, yMin) * (1.f - xA) * (1.f - yA) +
-            getColor(xMin, yMax) * (1.f - xA) * yA +
-            getColor(xMax, yMax) * xA * yA +
-            getColor(xMax, yMin) * xA * (1.f - yA);
+            getColor<Format>(level, xMin, yMin) * (1.f - xA) * (1.f - yA) +
+            getColor<Format>(level, xMin, yMax) * (1.f - xA) * yA +
+            getColor<Format>(level, xMax, yMax) * xA * yA +
+            getColor<Format>(level, xMax, yMin) * xA * (1.f - yA);
+    }
+
+    template <TextureFormat Format>
+    Vec3 getColor(const MipLevel& level, int x, int y) const {
+
+        // Repeat the border indefinitely
+        x = std::clamp(x, 0, level.w - 1);
+        y = std::clamp(y, 0, level.h - 1);
+
+        if constexpr (Format == TextureFormat::RGB32F) {
+            return level.texelsRGB32F[level.texelIndex(x, y)];
+        }
+        else if constexpr (Format == TextureFormat::RGBA8) {
+            const auto& texel = level.texelsRGBA8[level.texelIndex(x, y)];
+            return { toLinear[texel[0]], toLinear[texel[1]], toLinear[texel[2]] };
+        }
+        else {
+            const BC1Block& block = level.blocksBC1[level.tileIndex(x, y)];
+            const int index = (block.indices >> (2 * ((y % 4) * 4 + x % 4))) & 3;
+            const auto texel = DecodeBC1(block, index);
+            return { toLinear[texel[0]], toLinear[texel[1]], toLinear[texel[2]] };
+        }
     }
 
 };
 
-// Read a texture from a ppm image
-extern Texture ReadTexture(const std::string& filename, float gamma = 2.2f);
\ No newline at end of file
+// Read a texture from a ppm image, with its mip chain
+extern Texture ReadTexture(const std::string& filename, float gamma = 2.2f, TextureFormat format = TextureFormat::RGB32F);
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Persistent pool of worker threads, used by the parallel stages of the pipeline.
+// The calling thread takes part in the work as worker 0.
+class ThreadPool {
+
+public:
+
+	explicit ThreadPool(int threads = std::thread::hardware_concurrency());
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Number of workers, including the calling thread
+	int size() const {
+		return static_cast<int>(workers.size()) + 1;
+	}
+
+	// Call fn(index, worker) for each index in [0, count) and wait for completion.
+	// worker is in [0, min(size(), maxWorkers)) and identifies the thread running the call,
+	// so that callers can keep per-worker state without locks.
+	// Calls from inside a worker are executed serially. If calls throw, the remaining indices are
+	// skipped and the first exception is rethrown once the workers are done.
+	template <typename Fn>
+	void parallelFor(int count, Fn&& fn, int maxWorkers = 0) {
+		// fn is only referenced, not copied as in a std::function, which could allocate
+		using F = std::remove_reference_t<Fn>;
+		run(count, { const_cast<void*>(static_cast<const void*>(std::addressof(fn))), [](void* f, int index, int worker) {
+			(*static_cast<F*>(f))(index, worker);
+			} }, maxWorkers);
+	}
+
+	// Index of the worker of its pool running the calling thread, 0 outside the workers
+	static int currentWorker();
+
+private:
+
+	struct Job {
+		void* fn = nullptr;
+		void (*call)(void*, int, int) = nullptr;
+
+		void operator()(int index, int worker) const {
+			call(fn, index, worker);
+		}
+	};
+
+	void run(int count, Job fn, int maxWorkers);
+
+	void workerLoop(int worker);
+	void runJob(int worker);
+
+	std::vector<std::thread> workers;
+
+	std::mutex submitMutex;		// Only one job at a time
+	std::mutex mutex;
+	std::condition_variable wakeCond;
+	std::condition_variable doneCond;
+
+	Job job;
+	int jobCount = 0;
+	int jobWorkers = 0;
+	std::atomic<int> nextIndex = 0;
+	int busyWorkers = 0;
+	std::exception_ptr error;	// First exception of the workers in the current job
+	unsigned generation = 0;
+	bool stopping = false;
+
+};
+
+// Pool shared by the whole program, created on first use
+ThreadPool& DefaultThreadPool();
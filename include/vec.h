@@ -1,6 +1,9 @@
 #pragma once
 
 #include <array>
+#include <cmath>
+
+#include "simd.h"
 
 struct Vec2 {
 
@@ -145,20 +148,40 @@ struct Vec4 {
 
 };
 
+// Vec4 operations use SSE when available
+
 inline Vec4 operator*(const Vec4& v, float f) {
+#if defined(RASTERIZER_SSE2)
+    Vec4 res;
+    _mm_storeu_ps(&res[0], _mm_mul_ps(_mm_loadu_ps(&v[0]), _mm_set1_ps(f)));
+    return res;
+#else
     return Vec4{ v.x * f, v.y * f, v.z * f, v.w * f };
+#endif
 }
 
 inline Vec4 operator*(float f, const Vec4& v) {
-    return Vec4{ v.x * f, v.y * f, v.z * f, v.w * f };
+    return v * f;
 }
 
 inline Vec4 operator/(const Vec4& v, float f) {
+#if defined(RASTERIZER_SSE2)
+    Vec4 res;
+    _mm_storeu_ps(&res[0], _mm_div_ps(_mm_loadu_ps(&v[0]), _mm_set1_ps(f)));
+    return res;
+#else
     return Vec4{ v.x / f, v.y / f, v.z / f, v.w / f };
+#endif
 }
 
 inline Vec4 operator+(const Vec4& a, const Vec4& b) {
+#if defined(RASTERIZER_SSE2)
+    Vec4 res;
+    _mm_storeu_ps(&res[0], _mm_add_ps(_mm_loadu_ps(&a[0]), _mm_loadu_ps(&b[0])));
+    return res;
+#else
     return Vec4{ a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w };
+#endif
 }
 
 inline float norm(const Vec4& v) {
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <vector>
+#include <tuple>
+#include <span>
+#include <algorithm>
 
 #include "vec.h"
 #include "mat.h"
@@ -11,6 +14,7 @@ struct Vertex {
     Vec4 pos;
     std::tuple<Attr...> attr;
 
+    Vertex() = default;
     Vertex(Vec4 pos_, Attr... attr_) : pos(std::move(pos_)), attr(std::move(attr_)...) {}
 
 };
@@ -23,18 +27,48 @@ struct BasicVertShader {
 
 };
 
+// Vertex shaders can optionally provide:
+// - void prepare(), called once per draw before any vertex is shaded
+// - void shadeBatch(std::span<const VertAttr> in, std::span<VertOut> out), which shades many vertices
+//   at once and is used by the pipeline instead of operator()
+
 struct CubeVertShader {
 
     Mat4 model = 1.f;
     Mat4 view = 1.f;
     Mat4 projection = 1.f;
 
-    auto operator()(Vec3 pos, Vec2 tex) {
-        Vec4 pos4 = { pos.x, pos.y, pos.z, 1.0f };
-        //pos4 = projection * view * model * pos4;
-        pos4 = view * model * pos4;
-        pos4 = projection * pos4;
-        return Vertex(pos4, tex);
+    Mat4 mvp = 1.f;     // Set by prepare()
+
+    // Same transform as shadeBatch(), prepare() must have been called
+    auto operator()(Vec3 pos, Vec2 tex) const {
+        return Vertex(mvp * Vec4{ pos.x, pos.y, pos.z, 1.0f }, tex);
+    }
+
+    void prepare() {
+        mvp = projection * view * model;
+    }
+
+    // Positions are transformed in groups, converted to structure of arrays
+    void shadeBatch(std::span<const std::tuple<Vec3, Vec2>> in, std::span<Vertex<Vec2>> out) const {
+
+        constexpr size_t group = 64;
+        float x[group], y[group], z[group];
+        float cx[group], cy[group], cz[group], cw[group];
+
+        for (size_t start = 0; start < in.size(); start += group) {
+            const size_t n = std::min(group, in.size() - start);
+            for (size_t i = 0; i < n; ++i) {
+                const Vec3& pos = std::get<0>(in[start + i]);
+                x[i] = pos.x;
+                y[i] = pos.y;
+                z[i] = pos.z;
+            }
+            TransformPoints(mvp, n, x, y, z, cx, cy, cz, cw);
+            for (size_t i = 0; i < n; ++i) {
+                out[start + i] = Vertex(Vec4{ cx[i], cy[i], cz[i], cw[i] }, std::get<1>(in[start + i]));
+            }
+        }
     }
 
 };
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "arena.h"
+
+// Visibility buffer of the deferred mode (see RasterMode::Deferred): for each pixel, the triangle of
+// the draw that sets its color and the barycentric coordinates of the pixel center in it. Depths are
+// kept in the framebuffer. Can be passed in DrawOptions to be reused by the draws, otherwise each
+// deferred draw makes its own, from the frame arena if it has one.
+struct VisibilityBuffer {
+
+	static constexpr uint32_t kNoTriangle = ~uint32_t(0);
+
+	struct Sample {
+		uint32_t triangle;
+		float wa, wb, wc;
+	};
+
+	int w = 0;
+	int h = 0;
+
+	// Row-major
+	ArenaVector<Sample> samples;
+
+	VisibilityBuffer() = default;
+
+	// Samples taken from arena, or from the heap if it is null
+	explicit VisibilityBuffer(Arena* arena) : samples(ArenaAllocator<Sample>(arena)) {}
+
+	VisibilityBuffer(int w_, int h_) {
+		resize(w_, h_);
+	}
+
+	void resize(int w_, int h_) {
+		w = w_;
+		h = h_;
+		samples.resize(size_t(w) * h);
+	}
+
+	Sample& at(int x, int y) {
+		return samples[size_t(y) * w + x];
+	}
+
+	const Sample& at(int x, int y) const {
+		return samples[size_t(y) * w + x];
+	}
+
+	// Clear the rectangle [x0, x1) x [y0, y1)
+	void clear(int x0, int y0, int x1, int y1) {
+		for (int y = y0; y < y1; ++y) {
+			std::fill(&at(x0, y), &at(x0, y) + (x1 - x0), Sample{ kNoTriangle, 0.f, 0.f, 0.f });
+		}
+	}
+
+};
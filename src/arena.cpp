@@ -0,0 +1,61 @@
+#include "arena.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+void* Arena::allocateBlock(size_t size, size_t align) {
+
+	// Blocks are only added during a frame, the end of the current one is left unused
+	if (!blocks.empty()) {
+		usedBefore += offset;
+	}
+	const size_t newSize = std::max(blockSize, size + align);
+	blocks.push_back({ std::unique_ptr<std::byte[], BlockDeleter>(new (std::align_val_t(kArenaAlignment)) std::byte[newSize]), newSize });
+	current = blocks.size() - 1;
+	offset = 0;
+	return allocate(size, align);
+}
+
+void Arena::reset() {
+
+	if (blocks.size() > 1) {
+		const size_t total = capacity();
+		blocks.clear();
+		blocks.push_back({ std::unique_ptr<std::byte[], BlockDeleter>(new (std::align_val_t(kArenaAlignment)) std::byte[total]), total });
+	}
+	current = 0;
+	offset = 0;
+	usedBefore = 0;
+}
+
+size_t Arena::capacity() const {
+	size_t total = 0;
+	for (const Block& block : blocks) {
+		total += block.size;
+	}
+	return total;
+}
+
+Arena& FrameArena::local() {
+	const int worker = ThreadPool::currentWorker();
+	if (worker >= static_cast<int>(arenas.size())) {
+		throw std::out_of_range("FrameArena: more workers than arenas");
+	}
+	return arenas[worker];
+}
+
+size_t FrameArena::used() const {
+	size_t total = 0;
+	for (const Arena& arena : arenas) {
+		total += arena.used();
+	}
+	return total;
+}
+
+size_t FrameArena::capacity() const {
+	size_t total = 0;
+	for (const Arena& arena : arenas) {
+		total += arena.capacity();
+	}
+	return total;
+}
@@ -0,0 +1,117 @@
+#include "color.h"
+
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+namespace {
+
+float PowToLinear(float v, float gamma) {
+	return std::pow(v, gamma);
+}
+
+float PowFromLinear(float v, float gamma) {
+	return std::pow(v, 1.f / gamma);
+}
+
+float SRGBToLinear(float v, float) {
+	return v <= 0.04045f ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+}
+
+float SRGBFromLinear(float v, float) {
+	return v <= 0.0031308f ? v * 12.92f : 1.055f * std::pow(v, 1.f / 2.4f) - 0.055f;
+}
+
+}
+
+ColorCurve::ColorCurve(CurveFn toLinearFn_, CurveFn fromLinearFn, float param_) : toLinearFn(toLinearFn_), param(param_) {
+
+	for (int i = 0; i < 256; ++i) {
+		decode8[i] = toLinearFn(i / 255.f, param);
+	}
+
+	// Segment i starts at the float with bits kMinSegmentedBits + (i << kFractionBits)
+	for (int i = 0; i <= kSegments; ++i) {
+		const float start = std::bit_cast<float>(kMinSegmentedBits + (uint32_t(i) << kFractionBits));
+		const float end = std::bit_cast<float>(kMinSegmentedBits + (uint32_t(i + 1) << kFractionBits));
+		encodeStart[i] = fromLinearFn(start, param);
+		encodeSlope[i] = i < kSegments ? fromLinearFn(end, param) - encodeStart[i] : 0.f;
+	}
+	lowSlope = fromLinearFn(kMinSegmented, param) / kMinSegmented;
+}
+
+std::vector<float> ColorCurve::toLinearTable(int maxValue) const {
+	std::vector<float> res(maxValue + 1);
+	for (int i = 0; i <= maxValue; ++i) {
+		res[i] = toLinearFn(static_cast<float>(i) / maxValue, param);
+	}
+	return res;
+}
+
+void ColorCurve::fromLinear8(const float* in, int n, uint8_t* out) const {
+
+	int i = 0;
+
+#if defined(RASTERIZER_SSE2)
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.f);
+	const __m128 minSegmented = _mm_set1_ps(kMinSegmented);
+	const __m128i fractionMask = _mm_set1_epi32(kFractionMask);
+
+	for (; i + 4 <= n; i += 4) {
+		const __m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i), zero), one);
+		const __m128i bits = _mm_sub_epi32(_mm_castps_si128(v), _mm_set1_epi32(kMinSegmentedBits));
+		const __m128 t = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(bits, fractionMask)), _mm_set1_ps(1.f / (1 << kFractionBits)));
+
+		// No gathers in SSE2, segments are loaded one by one. Values below the table get a valid
+		// segment index, and are replaced afterwards.
+		alignas(16) int32_t segments[4];
+		_mm_store_si128(reinterpret_cast<__m128i*>(segments), _mm_srli_epi32(_mm_andnot_si128(_mm_srai_epi32(bits, 31), bits), kFractionBits));
+		for (int k = 0; k < 4; ++k) {
+			segments[k] = std::min(segments[k], kSegments);
+		}
+		const __m128 start = _mm_setr_ps(encodeStart[segments[0]], encodeStart[segments[1]], encodeStart[segments[2]], encodeStart[segments[3]]);
+		const __m128 slope = _mm_setr_ps(encodeSlope[segments[0]], encodeSlope[segments[1]], encodeSlope[segments[2]], encodeSlope[segments[3]]);
+
+		const __m128 segmented = _mm_add_ps(start, _mm_mul_ps(slope, t));
+		const __m128 low = _mm_mul_ps(v, _mm_set1_ps(lowSlope));
+		const __m128 isLow = _mm_cmplt_ps(v, minSegmented);
+		const __m128 res = _mm_or_ps(_mm_and_ps(isLow, low), _mm_andnot_ps(isLow, segmented));
+
+		const __m128i ints = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(res, _mm_set1_ps(255.f)), _mm_set1_ps(0.5f)));
+		const __m128i shorts = _mm_packs_epi32(ints, ints);
+		const int bytes = _mm_cvtsi128_si32(_mm_packus_epi16(shorts, shorts));
+		std::memcpy(out + i, &bytes, 4);
+	}
+#endif
+
+	for (; i < n; ++i) {
+		out[i] = fromLinear8(in[i]);
+	}
+}
+
+ColorCurve ColorCurve::SRGB() {
+	return ColorCurve(SRGBToLinear, SRGBFromLinear, 0.f);
+}
+
+ColorCurve ColorCurve::Gamma(float gamma) {
+	return ColorCurve(PowToLinear, PowFromLinear, gamma);
+}
+
+const ColorCurve& SRGBCurve() {
+	static const ColorCurve curve = ColorCurve::SRGB();
+	return curve;
+}
+
+const ColorCurve& GammaCurve(float gamma) {
+	static std::mutex mutex;
+	static std::map<float, ColorCurve> curves;
+
+	std::lock_guard lock(mutex);
+	auto it = curves.find(gamma);
+	if (it == curves.end()) {
+		it = curves.emplace(gamma, ColorCurve::Gamma(gamma)).first;
+	}
+	return it->second;
+}
@@ -1,5 +1,11 @@
 #define _USE_MATH_DEFINES
 #include <cmath>
+#include <memory>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
 
 #include "vec.h"
 #include "mat.h"
@@ -7,19 +13,54 @@
 #include "fragment.h"
 #include "texture.h"
 #include "framebuffer.h"
+#include "arena.h"
 #include "pipeline.h"
 #include "output.h"
+#include "sequence.h"
 
 
-int main(void) {
+int main(int argc, char** argv) {
+
+	// --frames N renders N frames of the cube rotating a full turn, to img_0000.ppm and following.
+	// --stats instruments the draws, printing their statistics and writing overdraw heatmaps.
+	// --msaa 4 or 8 draws with that many samples per pixel, resolved before the output.
+	int frameCount = 1;
+	bool instrumented = false;
+	int msaa = 1;
+	for (int i = 1; i < argc; ++i) {
+		if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+			frameCount = std::max(std::atoi(argv[++i]), 1);
+		}
+		else if (std::strcmp(argv[i], "--stats") == 0) {
+			instrumented = true;
+		}
+		else if (std::strcmp(argv[i], "--msaa") == 0 && i + 1 < argc) {
+			msaa = std::atoi(argv[++i]);
+		}
+	}
 
 	constexpr int scale = 1;
 	constexpr int w = 1920 / scale;
 	constexpr int h = 1080 / scale;
 
-	Framebuffer framebuffer(w, h);
+	// 8 bit colors and 24 bit depths (8 bytes per pixel instead of 20), stored in 8x8 tiles.
+	// Two framebuffers, so that a frame is written while the next one is rendered.
+	using FB = BasicFramebuffer<ColorRGBA8, Depth24, TiledLayout<8>>;
+	FramebufferPool<FB> framebuffers(w, h, 2);
+
+	// Multisampled framebuffer drawn into instead, only allocated if used
+	using FB4 = BasicFramebuffer<ColorRGBA8, Depth24, TiledLayout<8>, 4>;
+	using FB8 = BasicFramebuffer<ColorRGBA8, Depth24, TiledLayout<8>, 8>;
+	std::unique_ptr<FB4> framebuffer4;
+	std::unique_ptr<FB8> framebuffer8;
+	if (msaa == 4) {
+		framebuffer4 = std::make_unique<FB4>(w, h);
+	}
+	else if (msaa == 8) {
+		framebuffer8 = std::make_unique<FB8>(w, h);
+	}
 
-	Texture texture = ReadTexture("../data/greywall.ppm");
+	const auto texture = std::make_shared<const Texture>(ReadTexture("../data/greywall.ppm", 2.2f, TextureFormat::RGBA8));
 
 	/*std::vector<std::tuple<Vec3, Vec4, Vec2>> vertices{
 		{{-1.0f, -1.0f, 0.f}, {1.f, 0.f, 0.f, 1.f}, {0.0f, 1.0f }},
@@ -36,64 +77,126 @@ int main(void) {
 
    };*/
 
+	// Each face is made of two triangles: { 0, 1, 2 } and { 2, 3, 0 }, counterclockwise seen from outside
 	std::vector<std::tuple<Vec3, Vec2>> vertices{
 		// back face
 		{{-0.5f, -0.5f, -0.5f}, {0.0f, 0.0f}},
-		{{ 0.5f, -0.5f, -0.5f}, {1.0f, 0.0f}},
-		{{ 0.5f,  0.5f, -0.5f}, {1.0f, 1.0f}},
-		{{ 0.5f,  0.5f, -0.5f}, {1.0f, 1.0f}},
 		{{-0.5f,  0.5f, -0.5f}, {0.0f, 1.0f}},
-		{{-0.5f, -0.5f, -0.5f}, {0.0f, 0.0f}},
+		{{ 0.5f,  0.5f, -0.5f}, {1.0f, 1.0f}},
+		{{ 0.5f, -0.5f, -0.5f}, {1.0f, 0.0f}},
 		// front face
 		//{{-0.5f, -0.5f,  0.5f}, {0.0f, 0.0f}},
 		//{{ 0.5f, -0.5f,  0.5f}, {1.0f, 0.0f}},
 		//{{ 0.5f,  0.5f,  0.5f}, {1.0f, 1.0f}},
-		//{{ 0.5f,  0.5f,  0.5f}, {1.0f, 1.0f}},
 		//{{-0.5f,  0.5f,  0.5f}, {0.0f, 1.0f}},
-		//{{-0.5f, -0.5f,  0.5f}, {0.0f, 0.0f}},
 		// left face
 		{{-0.5f, -0.5f, -0.5f}, {0.0f, 0.0f}},
-		{{-0.5f,  0.5f, -0.5f}, {1.0f, 0.0f}},
-		{{-0.5f,  0.5f,  0.5f}, {1.0f, 1.0f}},
-		{{-0.5f,  0.5f,  0.5f}, {1.0f, 1.0f}},
 		{{-0.5f, -0.5f,  0.5f}, {0.0f, 1.0f}},
-		{{-0.5f, -0.5f, -0.5f}, {0.0f, 0.0f}},
+		{{-0.5f,  0.5f,  0.5f}, {1.0f, 1.0f}},
+		{{-0.5f,  0.5f, -0.5f}, {1.0f, 0.0f}},
 		// right face
 		 {{0.5f, -0.5f, -0.5f}, {0.0f, 0.0f}},
 		 {{0.5f,  0.5f, -0.5f}, {1.0f, 0.0f}},
 		 {{0.5f,  0.5f,  0.5f}, {1.0f, 1.0f}},
-		 {{0.5f,  0.5f,  0.5f}, {1.0f, 1.0f}},
 		 {{0.5f, -0.5f,  0.5f}, {0.0f, 1.0f}},
-		 {{0.5f, -0.5f, -0.5f}, {0.0f, 0.0f}},
 		// bottom face      
 		{{-0.5f, -0.5f, -0.5f}, {0.0f, 0.0f}},
 		{{ 0.5f, -0.5f, -0.5f}, {1.0f, 0.0f}},
 		{{ 0.5f, -0.5f,  0.5f}, {1.0f, 1.0f}},
-		{{ 0.5f, -0.5f,  0.5f}, {1.0f, 1.0f}},
 		{{-0.5f, -0.5f,  0.5f}, {0.0f, 1.0f}},
-		{{-0.5f, -0.5f, -0.5f}, {0.0f, 0.0f}},
 		// top face
 		{{-0.5f,  0.5f, -0.5f}, {0.0f, 0.0f}},
-		{{ 0.5f,  0.5f, -0.5f}, {1.0f, 0.0f}},
-		{{ 0.5f,  0.5f,  0.5f}, {1.0f, 1.0f}},
-		{{ 0.5f,  0.5f,  0.5f}, {1.0f, 1.0f}},
 		{{-0.5f,  0.5f,  0.5f}, {0.0f, 1.0f}},
-		{{-0.5f,  0.5f, -0.5f}, {0.0f, 0.0f}}
+		{{ 0.5f,  0.5f,  0.5f}, {1.0f, 1.0f}},
+		{{ 0.5f,  0.5f, -0.5f}, {1.0f, 0.0f}}
 	};
 
-	framebuffer.clear({ 0.1f,0.1f,0.2f,1.f });
+	std::vector<uint32_t> indices;
+	for (uint32_t face = 0; face < vertices.size() / 4; ++face) {
+		for (uint32_t i : { 0, 1, 2, 2, 3, 0 }) {
+			indices.push_back(face * 4 + i);
+		}
+	}
+
 	CubeVertShader cube_vert;
-	cube_vert.model =
-		translation({ 0.f, 0.1f, -2.f }) *
-		rotation(0.8f * (float)M_PI / 4.f, normalize(Vec3{1.f, 1.f, 1.f}))*
-		scaling(1.0f);
 	Vec3 eye = { 0.f, 0.0f, 0.f };
 	cube_vert.view = lookAt(eye, eye + Vec3{ 0.0f, 0.f, -1.f }, Vec3{ 0.f, 1.f, 0.f });
 	cube_vert.projection = projection((float)M_PI / 4.f, (float)w / h, 0.1f, 10.f);
-	DrawTriangles(framebuffer, std::span{ vertices.begin(), 30}, cube_vert, TextureFragShader(texture));
-	//DrawTriangles(framebuffer, std::span{ vertices.begin() + 3, 3 }, BasicVertShader(), BasicFragShader());
-	//DrawTriangles(framebuffer, std::span{ vertices.begin() + 6, 3 }, BasicVertShader(), TextureFragShader(texture));
+	const TextureFragShader texture_frag(texture);
+	DrawOptions options;
+	options.mode = RasterMode::Binned;
+	// The front face is missing and the inside of the cube is visible, so no face can be culled.
+	// With a closed cube, CullMode::Back would skip the half of the faces facing away.
+	options.cull = CullMode::None;
+
+	OverdrawMap overdraw(w, h);
+	options.overdraw = &overdraw;
+
+	// Transient memory of the draws, reset at the start of each frame
+	FrameArena arena;
+	options.arena = &arena;
+
+	// img.ppm for a single frame, img_0000.ppm and following for sequences
+	const auto frameFilename = [&](const char* prefix, int frame) {
+		if (frameCount == 1) {
+			return std::string(prefix) + ".ppm";
+		}
+		char name[64];
+		std::snprintf(name, sizeof(name), "%s_%04d.ppm", prefix, frame);
+		return std::string(name);
+	};
+
+	// The texture shader is opaque, so colors are written without blending
+	const auto draw = [&](int frame, auto& framebuffer) {
+		framebuffer.clear({ 0.1f,0.1f,0.2f,1.f });
+		if (instrumented) {
+			overdraw.clear();
+			const DrawStats drawStats = DrawIndexedTriangles<Instrumented<OpaqueState>>(framebuffer, std::span{ vertices },
+				std::span<const uint32_t>{ indices }, cube_vert, texture_frag, options);
+			std::cout << "frame " << frame << "\n";
+			drawStats.print(std::cout);
+			WriteImg(frameFilename("overdraw", frame), overdraw.heatmap());
+		}
+		else {
+			DrawIndexedTriangles<OpaqueState>(framebuffer, std::span{ vertices }, std::span<const uint32_t>{ indices }, cube_vert, texture_frag, options);
+		}
+		//DrawTriangles(framebuffer, std::span{ vertices.begin() + 3, 3 }, BasicVertShader(), BasicFragShader());
+		//DrawTriangles(framebuffer, std::span{ vertices.begin() + 6, 3 }, BasicVertShader(), TextureFragShader(texture));
+	};
+
+	const auto render = [&](int frame, FB& framebuffer) {
+		arena.reset();
+		const float angle = 0.8f * (float)M_PI / 4.f + 2.f * (float)M_PI * frame / frameCount;
+		cube_vert.model =
+			translation({ 0.f, 0.1f, -2.f }) *
+			rotation(angle, normalize(Vec3{ 1.f, 1.f, 1.f })) *
+			scaling(1.0f);
+
+		if (framebuffer4) {
+			draw(frame, *framebuffer4);
+			Resolve(*framebuffer4, framebuffer);
+		}
+		else if (framebuffer8) {
+			draw(frame, *framebuffer8);
+			Resolve(*framebuffer8, framebuffer);
+		}
+		else {
+			draw(frame, framebuffer);
+		}
+	};
+
+	// Runs on the output thread, converting serially while the thread pool renders the next frame
+	Image image;
+	ImageScratch scratch;
+	const auto output = [&](int frame, const FB& framebuffer) {
+		const std::string filename = frameFilename("img", frame);
+		ToImage(framebuffer, image, nullptr, nullptr, &scratch);
+		WriteImage(filename, image, ImageFormatFromFilename(filename));
+	};
 
-	WriteImg("img.ppm", framebuffer);
+	const SequenceStats stats = RenderSequence(framebuffers, frameCount, render, output);
+	if (frameCount > 1) {
+		stats.print(std::cout);
+	}
 
-}
\ No newline at end of file
+}
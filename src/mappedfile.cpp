@@ -0,0 +1,99 @@
+#include "mappedfile.h"
+
+#include <stdexcept>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+
+MappedFile::MappedFile(const std::string& filename) {
+
+	file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		file = nullptr;
+		throw std::runtime_error("MappedFile: can't open file");
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize)) {
+		CloseHandle(file);
+		throw std::runtime_error("MappedFile: can't read file size");
+	}
+	length = static_cast<size_t>(fileSize.QuadPart);
+	if (length == 0) {
+		// Empty files can't be mapped
+		return;
+	}
+
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	ptr = mapping ? static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+	if (!ptr) {
+		if (mapping) {
+			CloseHandle(mapping);
+		}
+		CloseHandle(file);
+		throw std::runtime_error("MappedFile: can't map file");
+	}
+}
+
+MappedFile::~MappedFile() {
+	if (ptr) {
+		UnmapViewOfFile(ptr);
+	}
+	if (mapping) {
+		CloseHandle(mapping);
+	}
+	if (file) {
+		CloseHandle(file);
+	}
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& filename) {
+
+	const int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw std::runtime_error("MappedFile: can't open file");
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		throw std::runtime_error("MappedFile: can't read file size");
+	}
+	length = static_cast<size_t>(st.st_size);
+	if (length == 0) {
+		// Empty files can't be mapped
+		close(fd);
+		return;
+	}
+
+	void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	// The mapping keeps its own reference to the file
+	close(fd);
+	if (mapped == MAP_FAILED) {
+		throw std::runtime_error("MappedFile: can't map file");
+	}
+	ptr = static_cast<const uint8_t*>(mapped);
+
+	// The file is read front to back
+	madvise(mapped, length, MADV_SEQUENTIAL);
+}
+
+MappedFile::~MappedFile() {
+	if (ptr) {
+		munmap(const_cast<uint8_t*>(ptr), length);
+	}
+}
+
+#endif
@@ -1,13 +1,173 @@
 #include "mat.h"
+#include "simd.h"
 
-Vec4 operator*(const Mat4& m, const Vec4& v) {
-    Vec4 res = 0.f;
-    for (int i = 0; i < 4; ++i) {
-        for (int j = 0; j < 4; ++j) {
-            res[i] += m[i * 4 + j] * v[j];
-        }
-    }
-    return res;
+Mat4 scalar::inverse(const Mat4& m) {
+
+	const auto a = [&m](int r, int c) {
+		return m[r * 4 + c];
+	};
+
+	// 2x2 determinants of the first two rows (s) and of the last two rows (c)
+	const float s0 = a(0, 0) * a(1, 1) - a(1, 0) * a(0, 1);
+	const float s1 = a(0, 0) * a(1, 2) - a(1, 0) * a(0, 2);
+	const float s2 = a(0, 0) * a(1, 3) - a(1, 0) * a(0, 3);
+	const float s3 = a(0, 1) * a(1, 2) - a(1, 1) * a(0, 2);
+	const float s4 = a(0, 1) * a(1, 3) - a(1, 1) * a(0, 3);
+	const float s5 = a(0, 2) * a(1, 3) - a(1, 2) * a(0, 3);
+
+	const float c5 = a(2, 2) * a(3, 3) - a(3, 2) * a(2, 3);
+	const float c4 = a(2, 1) * a(3, 3) - a(3, 1) * a(2, 3);
+	const float c3 = a(2, 1) * a(3, 2) - a(3, 1) * a(2, 2);
+	const float c2 = a(2, 0) * a(3, 3) - a(3, 0) * a(2, 3);
+	const float c1 = a(2, 0) * a(3, 2) - a(3, 0) * a(2, 2);
+	const float c0 = a(2, 0) * a(3, 1) - a(3, 0) * a(2, 1);
+
+	const float invDet = 1.f / (s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0);
+
+	return Mat4({
+		(a(1, 1) * c5 - a(1, 2) * c4 + a(1, 3) * c3) * invDet,
+		(-a(0, 1) * c5 + a(0, 2) * c4 - a(0, 3) * c3) * invDet,
+		(a(3, 1) * s5 - a(3, 2) * s4 + a(3, 3) * s3) * invDet,
+		(-a(2, 1) * s5 + a(2, 2) * s4 - a(2, 3) * s3) * invDet,
+
+		(-a(1, 0) * c5 + a(1, 2) * c2 - a(1, 3) * c1) * invDet,
+		(a(0, 0) * c5 - a(0, 2) * c2 + a(0, 3) * c1) * invDet,
+		(-a(3, 0) * s5 + a(3, 2) * s2 - a(3, 3) * s1) * invDet,
+		(a(2, 0) * s5 - a(2, 2) * s2 + a(2, 3) * s1) * invDet,
+
+		(a(1, 0) * c4 - a(1, 1) * c2 + a(1, 3) * c0) * invDet,
+		(-a(0, 0) * c4 + a(0, 1) * c2 - a(0, 3) * c0) * invDet,
+		(a(3, 0) * s4 - a(3, 1) * s2 + a(3, 3) * s0) * invDet,
+		(-a(2, 0) * s4 + a(2, 1) * s2 - a(2, 3) * s0) * invDet,
+
+		(-a(1, 0) * c3 + a(1, 1) * c1 - a(1, 2) * c0) * invDet,
+		(a(0, 0) * c3 - a(0, 1) * c1 + a(0, 2) * c0) * invDet,
+		(-a(3, 0) * s3 + a(3, 1) * s1 - a(3, 2) * s0) * invDet,
+		(a(2, 0) * s3 - a(2, 1) * s1 + a(2, 2) * s0) * invDet
+		});
+}
+
+#if defined(RASTERIZER_SSE2)
+
+namespace {
+
+template <int X, int Y, int Z, int W>
+__m128 Swizzle(__m128 v) {
+	return _mm_shuffle_ps(v, v, _MM_SHUFFLE(W, Z, Y, X));
+}
+
+template <int X, int Y, int Z, int W>
+__m128 Shuffle(__m128 a, __m128 b) {
+	return _mm_shuffle_ps(a, b, _MM_SHUFFLE(W, Z, Y, X));
+}
+
+// Products of 2x2 row major matrices stored in a single register: A * B, A# * B and A * B#,
+// where # is the adjugate
+__m128 Mat2Mul(__m128 a, __m128 b) {
+	return _mm_add_ps(_mm_mul_ps(a, Swizzle<0, 3, 0, 3>(b)), _mm_mul_ps(Swizzle<1, 0, 3, 2>(a), Swizzle<2, 1, 2, 1>(b)));
+}
+
+__m128 Mat2AdjMul(__m128 a, __m128 b) {
+	return _mm_sub_ps(_mm_mul_ps(Swizzle<3, 3, 0, 0>(a), b), _mm_mul_ps(Swizzle<1, 1, 2, 2>(a), Swizzle<2, 3, 0, 1>(b)));
+}
+
+__m128 Mat2MulAdj(__m128 a, __m128 b) {
+	return _mm_sub_ps(_mm_mul_ps(a, Swizzle<3, 0, 3, 0>(b)), _mm_mul_ps(Swizzle<1, 0, 3, 2>(a), Swizzle<2, 1, 2, 1>(b)));
+}
+
+}
+
+// The matrix is split into the 2x2 blocks | A B |
+//                                         | C D |
+// and the blocks of the inverse are computed with the adjugates of the blocks
+Mat4 simd::inverse(const Mat4& m) {
+
+	const __m128 r0 = _mm_loadu_ps(&m[0]);
+	const __m128 r1 = _mm_loadu_ps(&m[4]);
+	const __m128 r2 = _mm_loadu_ps(&m[8]);
+	const __m128 r3 = _mm_loadu_ps(&m[12]);
+
+	const __m128 A = _mm_movelh_ps(r0, r1);
+	const __m128 B = _mm_movehl_ps(r1, r0);
+	const __m128 C = _mm_movelh_ps(r2, r3);
+	const __m128 D = _mm_movehl_ps(r3, r2);
+
+	// Determinants of the blocks, as (|A|, |B|, |C|, |D|)
+	const __m128 detSub = _mm_sub_ps(
+		_mm_mul_ps(Shuffle<0, 2, 0, 2>(r0, r2), Shuffle<1, 3, 1, 3>(r1, r3)),
+		_mm_mul_ps(Shuffle<1, 3, 1, 3>(r0, r2), Shuffle<0, 2, 0, 2>(r1, r3)));
+	const __m128 detA = Swizzle<0, 0, 0, 0>(detSub);
+	const __m128 detB = Swizzle<1, 1, 1, 1>(detSub);
+	const __m128 detC = Swizzle<2, 2, 2, 2>(detSub);
+	const __m128 detD = Swizzle<3, 3, 3, 3>(detSub);
+
+	const __m128 D_C = Mat2AdjMul(D, C);
+	const __m128 A_B = Mat2AdjMul(A, B);
+
+	// Adjugates of the blocks of the inverse, to be divided by |M|
+	__m128 X_ = _mm_sub_ps(_mm_mul_ps(detD, A), Mat2Mul(B, D_C));
+	__m128 W_ = _mm_sub_ps(_mm_mul_ps(detA, D), Mat2Mul(C, A_B));
+	__m128 Y_ = _mm_sub_ps(_mm_mul_ps(detB, C), Mat2MulAdj(D, A_B));
+	__m128 Z_ = _mm_sub_ps(_mm_mul_ps(detC, B), Mat2MulAdj(A, D_C));
+
+	// |M| = |A| |D| + |B| |C| - tr((A# B) (D# C))
+	__m128 tr = _mm_mul_ps(A_B, Swizzle<0, 2, 1, 3>(D_C));
+	tr = _mm_add_ps(tr, Swizzle<2, 3, 0, 1>(tr));
+	tr = _mm_add_ps(tr, Swizzle<1, 0, 3, 2>(tr));
+	const __m128 detM = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC)), tr);
+
+	const __m128 rDetM = _mm_div_ps(_mm_setr_ps(1.f, -1.f, -1.f, 1.f), detM);
+	X_ = _mm_mul_ps(X_, rDetM);
+	Y_ = _mm_mul_ps(Y_, rDetM);
+	Z_ = _mm_mul_ps(Z_, rDetM);
+	W_ = _mm_mul_ps(W_, rDetM);
+
+	// Apply the adjugate while storing
+	Mat4 res;
+	_mm_storeu_ps(&res[0], Shuffle<3, 1, 3, 1>(X_, Y_));
+	_mm_storeu_ps(&res[4], Shuffle<2, 0, 2, 0>(X_, Y_));
+	_mm_storeu_ps(&res[8], Shuffle<3, 1, 3, 1>(Z_, W_));
+	_mm_storeu_ps(&res[12], Shuffle<2, 0, 2, 0>(Z_, W_));
+	return res;
+}
+
+#endif
+
+void TransformPoints(const Mat4& m, size_t n, const float* x, const float* y, const float* z,
+	float* outX, float* outY, float* outZ, float* outW) {
+
+	float* out[4] = { outX, outY, outZ, outW };
+	size_t i = 0;
+
+#if defined(RASTERIZER_AVX)
+	for (; i + 8 <= n; i += 8) {
+		const __m256 px = _mm256_loadu_ps(x + i);
+		const __m256 py = _mm256_loadu_ps(y + i);
+		const __m256 pz = _mm256_loadu_ps(z + i);
+		for (int r = 0; r < 4; ++r) {
+			const __m256 xy = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[r * 4]), px), _mm256_mul_ps(_mm256_set1_ps(m[r * 4 + 1]), py));
+			const __m256 zw = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[r * 4 + 2]), pz), _mm256_set1_ps(m[r * 4 + 3]));
+			_mm256_storeu_ps(out[r] + i, _mm256_add_ps(xy, zw));
+		}
+	}
+#endif
+#if defined(RASTERIZER_SSE2)
+	for (; i + 4 <= n; i += 4) {
+		const __m128 px = _mm_loadu_ps(x + i);
+		const __m128 py = _mm_loadu_ps(y + i);
+		const __m128 pz = _mm_loadu_ps(z + i);
+		for (int r = 0; r < 4; ++r) {
+			const __m128 xy = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[r * 4]), px), _mm_mul_ps(_mm_set1_ps(m[r * 4 + 1]), py));
+			const __m128 zw = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[r * 4 + 2]), pz), _mm_set1_ps(m[r * 4 + 3]));
+			_mm_storeu_ps(out[r] + i, _mm_add_ps(xy, zw));
+		}
+	}
+#endif
+	for (; i < n; ++i) {
+		for (int r = 0; r < 4; ++r) {
+			out[r][i] = (m[r * 4] * x[i] + m[r * 4 + 1] * y[i]) + (m[r * 4 + 2] * z[i] + m[r * 4 + 3]);
+		}
+	}
 }
 
 Mat4 translation(const Vec3& v) {
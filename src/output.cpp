@@ -1,20 +1,222 @@
 #include "output.h"
 
-void WriteImg(const std::string& filename, const Framebuffer& framebuffer) {
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
 
+#include "png.h"
+#include "simd.h"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Write the buffers one after the other, with the fewest system calls
+void WriteFile(const std::string& filename, std::initializer_list<std::pair<const uint8_t*, size_t>> buffers) {
+
+#if defined(_WIN32)
 	std::ofstream os(filename, std::ios::binary);
-	const int w = framebuffer.w;
-	const int h = framebuffer.h;
+	if (!os) {
+		throw std::runtime_error("WriteImage: can't open file");
+	}
+	for (const auto& [data, size] : buffers) {
+		os.write(reinterpret_cast<const char*>(data), size);
+	}
+	if (!os) {
+		throw std::runtime_error("WriteImage: write failed");
+	}
+#else
+	const int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		throw std::runtime_error("WriteImage: can't open file");
+	}
 
-	os << "P6\n" << framebuffer.w << " " << framebuffer.h << " " << 255 << "\n";
-	for (int y = h - 1; y >= 0; --y) {
-		for (int x = 0; x < w; ++x) {
+	off_t offset = 0;
+	for (auto [data, size] : buffers) {
+		// Large writes may be partial
+		while (size > 0) {
+			const ssize_t written = pwrite(fd, data, size, offset);
+			if (written <= 0) {
+				close(fd);
+				throw std::runtime_error("WriteImage: write failed");
+			}
+			data += written;
+			size -= written;
+			offset += written;
+		}
+	}
+	close(fd);
+#endif
+}
+
+bool EndsWith(const std::string& s, const char* suffix) {
+	const size_t n = std::strlen(suffix);
+	if (s.size() < n) {
+		return false;
+	}
+	for (size_t i = 0; i < n; ++i) {
+		if (std::tolower(static_cast<unsigned char>(s[s.size() - n + i])) != suffix[i]) {
+			return false;
+		}
+	}
+	return true;
+}
 
-			const auto& color = framebuffer.getColor(x, y);
-			os.put(static_cast<uint8_t>(color.r * 255));
-			os.put(static_cast<uint8_t>(color.g * 255));
-			os.put(static_cast<uint8_t>(color.b * 255));
+}
+
+ImageFormat ImageFormatFromFilename(const std::string& filename) {
+	if (EndsWith(filename, ".png")) {
+		return ImageFormat::PNG;
+	}
+	if (EndsWith(filename, ".raw") || EndsWith(filename, ".rgb")) {
+		return ImageFormat::Raw;
+	}
+	return ImageFormat::PPM;
+}
+
+void QuantizeRGB8(const Vec4* colors, int n, uint8_t* rgb) {
+
+	int i = 0;
+
+#if defined(RASTERIZER_SSE2)
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.f);
+	const __m128 scale = _mm_set1_ps(255.f);
+	const __m128 half = _mm_set1_ps(0.5f);
+
+	const auto quantize = [&](const Vec4& color) {
+		const __m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(color.data.data()), zero), one);
+		return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, scale), half));
+	};
+
+	// 4 pixels at a time, packed to 16 bytes of RGBA. The last group stops one pixel early so
+	// that its 4 byte stores stay in the row.
+	for (; i + 5 <= n; i += 4) {
+		const __m128i shorts01 = _mm_packs_epi32(quantize(colors[i]), quantize(colors[i + 1]));
+		const __m128i shorts23 = _mm_packs_epi32(quantize(colors[i + 2]), quantize(colors[i + 3]));
+		alignas(16) uint8_t rgba[16];
+		_mm_store_si128(reinterpret_cast<__m128i*>(rgba), _mm_packus_epi16(shorts01, shorts23));
+
+		// Overlapping stores of 4 bytes, the alpha byte is overwritten by the next pixel
+		uint8_t* out = rgb + i * 3;
+		std::memcpy(out + 0, rgba + 0, 4);
+		std::memcpy(out + 3, rgba + 4, 4);
+		std::memcpy(out + 6, rgba + 8, 4);
+		std::memcpy(out + 9, rgba + 12, 4);
+	}
+#endif
+
+	for (; i < n; ++i) {
+		rgb[i * 3 + 0] = static_cast<uint8_t>(std::clamp(colors[i].r, 0.f, 1.f) * 255.f + 0.5f);
+		rgb[i * 3 + 1] = static_cast<uint8_t>(std::clamp(colors[i].g, 0.f, 1.f) * 255.f + 0.5f);
+		rgb[i * 3 + 2] = static_cast<uint8_t>(std::clamp(colors[i].b, 0.f, 1.f) * 255.f + 0.5f);
+	}
+}
+
+void WriteImage(const std::string& filename, const Image& image, ImageFormat format) {
+
+	const size_t size = image.rgb.size();
+
+	switch (format) {
+	case ImageFormat::PNG:
+	case ImageFormat::PNGStored: {
+		const std::vector<uint8_t> png = EncodePNG(image.rgb.data(), image.w, image.h, format == ImageFormat::PNG);
+		WriteFile(filename, { { png.data(), png.size() } });
+		break;
+	}
+	case ImageFormat::Raw:
+		WriteFile(filename, { { image.rgb.data(), size } });
+		break;
+	case ImageFormat::PPM:
+	default: {
+		const std::string header = "P6\n" + std::to_string(image.w) + " " + std::to_string(image.h) + " 255\n";
+		WriteFile(filename, { { reinterpret_cast<const uint8_t*>(header.data()), header.size() }, { image.rgb.data(), size } });
+		break;
+	}
+	}
+}
+
+AsyncImageWriter::AsyncImageWriter(int maxPending_) : maxPending(std::max(maxPending_, 1)) {
+	thread = std::thread([this] { writerLoop(); });
+}
+
+AsyncImageWriter::~AsyncImageWriter() {
+	{
+		std::lock_guard lock(mutex);
+		stopping = true;
+	}
+	queueCond.notify_one();
+	thread.join();
+}
+
+Image AsyncImageWriter::acquire() {
+	std::lock_guard lock(mutex);
+	if (freeImages.empty()) {
+		return {};
+	}
+	Image image = std::move(freeImages.back());
+	freeImages.pop_back();
+	return image;
+}
+
+void AsyncImageWriter::write(const std::string& filename, Image image, ImageFormat format) {
+	{
+		std::unique_lock lock(mutex);
+		doneCond.wait(lock, [&] { return queue.size() < maxPending || error; });
+		rethrowError();
+		queue.push_back({ filename, std::move(image), format });
+	}
+	queueCond.notify_one();
+}
+
+void AsyncImageWriter::wait() {
+	std::unique_lock lock(mutex);
+	doneCond.wait(lock, [&] { return (queue.empty() && !busy) || error; });
+	rethrowError();
+}
+
+void AsyncImageWriter::rethrowError() {
+	if (error) {
+		// Reported once, the writer keeps going with the next images
+		std::exception_ptr res = error;
+		error = nullptr;
+		std::rethrow_exception(res);
+	}
+}
+
+void AsyncImageWriter::writerLoop() {
+
+	std::unique_lock lock(mutex);
+	while (true) {
+		// Queued images are all written before exiting
+		queueCond.wait(lock, [&] { return !queue.empty() || stopping; });
+		if (queue.empty()) {
+			return;
+		}
+
+		Job job = std::move(queue.front());
+		queue.pop_front();
+		busy = true;
+		lock.unlock();
+
+		std::exception_ptr jobError;
+		try {
+			WriteImage(job.filename, job.image, job.format);
+		}
+		catch (...) {
+			jobError = std::current_exception();
+		}
 
+		lock.lock();
+		busy = false;
+		if (jobError && !error) {
+			error = jobError;
 		}
+		freeImages.push_back(std::move(job.image));
+		doneCond.notify_all();
 	}
 }
@@ -0,0 +1,284 @@
+#include "png.h"
+
+#include <array>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+uint32_t Crc32(const uint8_t* data, size_t size, uint32_t crc = 0) {
+
+	static const std::array<uint32_t, 256> table = [] {
+		std::array<uint32_t, 256> res;
+		for (uint32_t i = 0; i < 256; ++i) {
+			uint32_t c = i;
+			for (int k = 0; k < 8; ++k) {
+				c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			}
+			res[i] = c;
+		}
+		return res;
+	}();
+
+	crc = ~crc;
+	for (size_t i = 0; i < size; ++i) {
+		crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+uint32_t Adler32(const uint8_t* data, size_t size) {
+	uint32_t a = 1;
+	uint32_t b = 0;
+	while (size > 0) {
+		// Sums can't overflow in 5552 steps
+		const size_t n = std::min<size_t>(size, 5552);
+		for (size_t i = 0; i < n; ++i) {
+			a += data[i];
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+		data += n;
+		size -= n;
+	}
+	return b << 16 | a;
+}
+
+void PutU32(std::vector<uint8_t>& out, uint32_t v) {
+	out.push_back(static_cast<uint8_t>(v >> 24));
+	out.push_back(static_cast<uint8_t>(v >> 16));
+	out.push_back(static_cast<uint8_t>(v >> 8));
+	out.push_back(static_cast<uint8_t>(v));
+}
+
+void PutChunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data) {
+	PutU32(out, static_cast<uint32_t>(data.size()));
+	const size_t start = out.size();
+	out.insert(out.end(), type, type + 4);
+	out.insert(out.end(), data.begin(), data.end());
+	PutU32(out, Crc32(out.data() + start, out.size() - start));
+}
+
+// Deflate blocks of uncompressed data
+void DeflateStored(const std::vector<uint8_t>& in, std::vector<uint8_t>& out) {
+	size_t pos = 0;
+	do {
+		const size_t n = std::min<size_t>(in.size() - pos, 65535);
+		const bool last = pos + n == in.size();
+		out.push_back(last ? 1 : 0);
+		out.push_back(static_cast<uint8_t>(n));
+		out.push_back(static_cast<uint8_t>(n >> 8));
+		out.push_back(static_cast<uint8_t>(~n));
+		out.push_back(static_cast<uint8_t>(~n >> 8));
+		out.insert(out.end(), in.begin() + pos, in.begin() + pos + n);
+		pos += n;
+	} while (pos < in.size());
+}
+
+// Writes bits starting from the least significant, as deflate requires
+class BitWriter {
+
+public:
+
+	explicit BitWriter(std::vector<uint8_t>& out_) : out(out_) {}
+
+	void put(uint32_t bits, int count) {
+		buffer |= uint64_t(bits) << used;
+		used += count;
+		while (used >= 8) {
+			out.push_back(static_cast<uint8_t>(buffer));
+			buffer >>= 8;
+			used -= 8;
+		}
+	}
+
+	// Huffman codes are stored starting from the most significant bit
+	void putCode(uint32_t code, int length) {
+		uint32_t reversed = 0;
+		for (int i = 0; i < length; ++i) {
+			reversed |= ((code >> i) & 1) << (length - 1 - i);
+		}
+		put(reversed, length);
+	}
+
+	void flush() {
+		if (used > 0) {
+			out.push_back(static_cast<uint8_t>(buffer));
+		}
+		buffer = 0;
+		used = 0;
+	}
+
+private:
+
+	std::vector<uint8_t>& out;
+	uint64_t buffer = 0;
+	int used = 0;
+
+};
+
+constexpr int kLengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+constexpr int kLengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+constexpr int kDistBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+	4097, 6145, 8193, 12289, 16385, 24577 };
+constexpr int kDistExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+// Fixed Huffman code of a literal/length symbol
+void PutSymbol(BitWriter& bits, int symbol) {
+	if (symbol < 144) {
+		bits.putCode(0x30 + symbol, 8);
+	}
+	else if (symbol < 256) {
+		bits.putCode(0x190 + symbol - 144, 9);
+	}
+	else if (symbol < 280) {
+		bits.putCode(symbol - 256, 7);
+	}
+	else {
+		bits.putCode(0xc0 + symbol - 280, 8);
+	}
+}
+
+void PutMatch(BitWriter& bits, int length, int distance) {
+	const int lengthCode = static_cast<int>(std::upper_bound(std::begin(kLengthBase), std::end(kLengthBase), length) - std::begin(kLengthBase)) - 1;
+	PutSymbol(bits, 257 + lengthCode);
+	bits.put(length - kLengthBase[lengthCode], kLengthExtra[lengthCode]);
+
+	const int distCode = static_cast<int>(std::upper_bound(std::begin(kDistBase), std::end(kDistBase), distance) - std::begin(kDistBase)) - 1;
+	bits.putCode(distCode, 5);
+	bits.put(distance - kDistBase[distCode], kDistExtra[distCode]);
+}
+
+// Single block with the fixed Huffman codes. Matches are found with a hash table of the last
+// position of each 3 byte sequence, checking only that candidate.
+void DeflateFixed(const std::vector<uint8_t>& in, std::vector<uint8_t>& out) {
+
+	constexpr int kHashBits = 15;
+	constexpr size_t kWindow = 32768;
+	constexpr int kMinMatch = 3;
+	constexpr int kMaxMatch = 258;
+
+	std::vector<int64_t> head(size_t(1) << kHashBits, -1);
+	const auto hash = [&](size_t pos) {
+		const uint32_t v = in[pos] | in[pos + 1] << 8 | in[pos + 2] << 16;
+		return (v * 2654435761u) >> (32 - kHashBits);
+	};
+
+	BitWriter bits(out);
+	bits.put(1, 1);		// Last block
+	bits.put(1, 2);		// Fixed Huffman codes
+
+	size_t pos = 0;
+	while (pos < in.size()) {
+		int length = 0;
+		size_t distance = 0;
+		if (pos + kMinMatch <= in.size()) {
+			const uint32_t h = hash(pos);
+			const int64_t candidate = head[h];
+			head[h] = static_cast<int64_t>(pos);
+			if (candidate >= 0 && pos - candidate <= kWindow) {
+				const size_t maxLength = std::min<size_t>(kMaxMatch, in.size() - pos);
+				while (length < static_cast<int>(maxLength) && in[candidate + length] == in[pos + length]) {
+					++length;
+				}
+				distance = pos - candidate;
+			}
+		}
+
+		if (length >= kMinMatch) {
+			PutMatch(bits, length, static_cast<int>(distance));
+			// Index the skipped positions too, so that long runs keep matching
+			for (size_t i = pos + 1; i < pos + length && i + kMinMatch <= in.size(); ++i) {
+				head[hash(i)] = static_cast<int64_t>(i);
+			}
+			pos += length;
+		}
+		else {
+			PutSymbol(bits, in[pos]);
+			++pos;
+		}
+	}
+
+	PutSymbol(bits, 256);	// End of block
+	bits.flush();
+}
+
+// Filter each row with the filter giving the smallest sum of absolute values, a common heuristic
+// for the filter that compresses best
+std::vector<uint8_t> FilterRows(const uint8_t* rgb, int w, int h, bool compress) {
+
+	const size_t stride = size_t(w) * 3;
+	std::vector<uint8_t> res((stride + 1) * h);
+	std::vector<uint8_t> sub(stride);
+	std::vector<uint8_t> up(stride);
+
+	for (int y = 0; y < h; ++y) {
+		const uint8_t* row = rgb + y * stride;
+		uint8_t* out = res.data() + y * (stride + 1);
+
+		if (!compress) {
+			out[0] = 0;
+			std::memcpy(out + 1, row, stride);
+			continue;
+		}
+
+		const uint8_t* prev = y > 0 ? row - stride : nullptr;
+		const auto cost = [](uint8_t v) {
+			return v < 128 ? v : 256 - v;
+		};
+		size_t costNone = 0;
+		size_t costSub = 0;
+		size_t costUp = 0;
+		for (size_t i = 0; i < stride; ++i) {
+			sub[i] = static_cast<uint8_t>(row[i] - (i >= 3 ? row[i - 3] : 0));
+			up[i] = static_cast<uint8_t>(row[i] - (prev ? prev[i] : 0));
+			costNone += cost(row[i]);
+			costSub += cost(sub[i]);
+			costUp += cost(up[i]);
+		}
+
+		if (costNone <= costSub && costNone <= costUp) {
+			out[0] = 0;
+			std::memcpy(out + 1, row, stride);
+		}
+		else if (costSub <= costUp) {
+			out[0] = 1;
+			std::memcpy(out + 1, sub.data(), stride);
+		}
+		else {
+			out[0] = 2;
+			std::memcpy(out + 1, up.data(), stride);
+		}
+	}
+	return res;
+}
+
+}
+
+std::vector<uint8_t> EncodePNG(const uint8_t* rgb, int w, int h, bool compress) {
+
+	std::vector<uint8_t> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+	std::vector<uint8_t> header;
+	PutU32(header, w);
+	PutU32(header, h);
+	header.insert(header.end(), { 8, 2, 0, 0, 0 });	// 8 bit RGB, deflate, adaptive filters, no interlace
+	PutChunk(png, "IHDR", header);
+
+	const std::vector<uint8_t> filtered = FilterRows(rgb, w, h, compress);
+
+	std::vector<uint8_t> zlib = { 0x78, 0x01 };
+	if (compress) {
+		DeflateFixed(filtered, zlib);
+	}
+	else {
+		DeflateStored(filtered, zlib);
+	}
+	PutU32(zlib, Adler32(filtered.data(), filtered.size()));
+	PutChunk(png, "IDAT", zlib);
+
+	PutChunk(png, "IEND", {});
+	return png;
+}
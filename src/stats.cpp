@@ -0,0 +1,70 @@
+#include "stats.h"
+
+#include <algorithm>
+
+uint32_t OverdrawMap::max() const {
+	return counts.empty() ? 0 : *std::max_element(counts.begin(), counts.end());
+}
+
+Framebuffer OverdrawMap::heatmap(uint32_t maxCount) const {
+
+	if (maxCount == 0) {
+		maxCount = std::max(max(), 1u);
+	}
+
+	// Blue, cyan, green, yellow, red
+	const Vec4 ramp[] = {
+		{ 0.f, 0.f, 1.f, 1.f },
+		{ 0.f, 1.f, 1.f, 1.f },
+		{ 0.f, 1.f, 0.f, 1.f },
+		{ 1.f, 1.f, 0.f, 1.f },
+		{ 1.f, 0.f, 0.f, 1.f },
+	};
+	constexpr int segments = static_cast<int>(std::size(ramp)) - 1;
+
+	Framebuffer framebuffer(w, h);
+	framebuffer.clear({ 0.f, 0.f, 0.f, 1.f });
+	for (int y = 0; y < h; ++y) {
+		for (int x = 0; x < w; ++x) {
+			const uint32_t count = counts[size_t(y) * w + x];
+			if (count == 0) {
+				continue;
+			}
+			const float t = maxCount > 1 ? std::min(float(count - 1) / (maxCount - 1), 1.f) * segments : segments;
+			const int i = std::min(static_cast<int>(t), segments - 1);
+			framebuffer.setColor(x, y, ramp[i] * (1.f - (t - i)) + ramp[i + 1] * (t - i));
+		}
+	}
+	return framebuffer;
+}
+
+void DrawStats::add(const DrawStats& other) {
+	verticesShaded += other.verticesShaded;
+	trianglesSubmitted += other.trianglesSubmitted;
+	trianglesOutside += other.trianglesOutside;
+	trianglesClipped += other.trianglesClipped;
+	trianglesCulled += other.trianglesCulled;
+	trianglesEmpty += other.trianglesEmpty;
+	trianglesRasterized += other.trianglesRasterized;
+	fragmentsGenerated += other.fragmentsGenerated;
+	fragmentsShaded += other.fragmentsShaded;
+	depthPassed += other.depthPassed;
+	depthFailed += other.depthFailed;
+	pixelsWritten += other.pixelsWritten;
+	vertexMs += other.vertexMs;
+	setupMs += other.setupMs;
+	binningMs += other.binningMs;
+	rasterMs += other.rasterMs;
+	shadeMs += other.shadeMs;
+	totalMs += other.totalMs;
+}
+
+void DrawStats::print(std::ostream& os) const {
+	os << "vertices: " << verticesShaded << " shaded\n";
+	os << "triangles: " << trianglesSubmitted << " submitted, " << trianglesOutside << " outside, " << trianglesClipped << " clipped, "
+		<< trianglesCulled << " culled, " << trianglesEmpty << " empty, " << trianglesRasterized << " rasterized\n";
+	os << "fragments: " << fragmentsGenerated << " generated (" << overdraw() << " per pixel), " << fragmentsShaded << " shaded, "
+		<< depthPassed << " passed depth, " << depthFailed << " failed depth, " << pixelsWritten << " written\n";
+	os << "time: vertex " << vertexMs << " ms, setup " << setupMs << " ms, binning " << binningMs << " ms, raster " << rasterMs
+		<< " ms, shade " << shadeMs << " ms, total " << totalMs << " ms\n";
+}
@@ -1,46 +1,347 @@
 #include "texture.h"
+#include "color.h"
+#include "mappedfile.h"
+#include "threadpool.h"
 
+#include <cctype>
+#include <limits>
 #include <string>
-#include <fstream>
+#include <stdexcept>
 
-// Read a texture from a ppm image
-Texture ReadTexture(const std::string& filename, float gamma) {
+namespace {
 
-    std::ifstream is(filename, std::ios::binary);
-    if (!is.is_open()) {
-        throw std::runtime_error("ReadTexture: can't open file");
+// Halve the size of an image, averaging 2x2 texels. With odd sizes the last row/column is
+// dropped, the border is repeated when a side is 1.
+std::vector<Vec3> Downsample(const std::vector<Vec3>& src, int w, int h, int dstW, int dstH) {
+
+    const auto get = [&](int x, int y) {
+        return src[std::min(y, h - 1) * w + std::min(x, w - 1)];
+    };
+
+    std::vector<Vec3> dst(dstW * dstH);
+    for (int y = 0; y < dstH; ++y) {
+        for (int x = 0; x < dstW; ++x) {
+            dst[y * dstW + x] = (get(x * 2, y * 2) + get(x * 2 + 1, y * 2) + get(x * 2, y * 2 + 1) + get(x * 2 + 1, y * 2 + 1)) * 0.25f;
+        }
+    }
+    return dst;
+}
+
+using Texel8 = std::array<uint8_t, 4>;
+
+// Compress a 4x4 block, given as gamma encoded 8 bit texels. The endpoints are the corners of the
+// bounding box of the colors, along the diagonal that follows the correlation of the channels,
+// moved slightly inside the box; each texel takes the closest color of the palette.
+BC1Block EncodeBC1(const std::array<Texel8, 16>& texels) {
+
+    int lo[3] = { 255, 255, 255 };
+    int hi[3] = { 0, 0, 0 };
+    int mean[3] = { 0, 0, 0 };
+    for (const auto& t : texels) {
+        for (int i = 0; i < 3; ++i) {
+            lo[i] = std::min<int>(lo[i], t[i]);
+            hi[i] = std::max<int>(hi[i], t[i]);
+            mean[i] += t[i];
+        }
+    }
+
+    // Red and blue go from lo to hi if they grow with green, otherwise from hi to lo
+    int cov[3] = { 0, 0, 0 };
+    for (const auto& t : texels) {
+        for (int i = 0; i < 3; i += 2) {
+            cov[i] += (t[i] * 16 - mean[i]) * (t[1] * 16 - mean[1]);
+        }
     }
-    std::string buf;
-    is >> buf;
-    if (buf != "P6") {
-        throw std::runtime_error("ReadTexture: wrong magic number");
+    for (int i = 0; i < 3; i += 2) {
+        if (cov[i] < 0) {
+            std::swap(lo[i], hi[i]);
+        }
     }
-    int w, h, maxV;
-    is >> w;
-    is >> h;
-    is >> maxV;
-    is.get();
 
-    Texture tex(w, h);
+    const auto to565 = [](const int (&c)[3]) {
+        return static_cast<uint16_t>((c[0] * 31 + 127) / 255 << 11 | (c[1] * 63 + 127) / 255 << 5 | (c[2] * 31 + 127) / 255);
+    };
+
+    int end0[3], end1[3];
+    for (int i = 0; i < 3; ++i) {
+        const int inset = (hi[i] - lo[i]) / 16;
+        end0[i] = hi[i] - inset;
+        end1[i] = lo[i] + inset;
+    }
 
-    const uint8_t dataSize = maxV < 256 ? 1 : 2;
-    std::vector<uint8_t> data(w * h * 3 * dataSize);
-    is.read(reinterpret_cast<char*>(data.data()), data.size());
+    BC1Block block{ to565(end0), to565(end1), 0 };
+    if (block.color0 == block.color1) {
+        return block;
+    }
+    // Four colors mode
+    if (block.color0 < block.color1) {
+        std::swap(block.color0, block.color1);
+    }
 
-    for (int y = h - 1; y >= 0; --y) {
-        for (int x = 0; x < w; ++x) {
+    std::array<uint8_t, 3> palette[4];
+    for (int i = 0; i < 4; ++i) {
+        palette[i] = DecodeBC1(block, i);
+    }
+    for (int t = 0; t < 16; ++t) {
+        int best = 0;
+        int bestDist = 1 << 30;
+        for (int i = 0; i < 4; ++i) {
+            int dist = 0;
             for (int c = 0; c < 3; ++c) {
+                const int d = texels[t][c] - palette[i][c];
+                dist += d * d;
+            }
+            if (dist < bestDist) {
+                bestDist = dist;
+                best = i;
+            }
+        }
+        block.indices |= static_cast<uint32_t>(best) << (2 * t);
+    }
+    return block;
+}
+
+}
+
+Texture::Texture(int w_, int h_, std::vector<Vec3> colors, TextureFormat format_, float gamma) : w(w_), h(h_), format(format_) {
+
+    const ColorCurve& curve = GammaCurve(gamma);
+    for (int i = 0; i < 256; ++i) {
+        toLinear[i] = curve.toLinear8(static_cast<uint8_t>(i));
+    }
+    const auto encode = [&curve](const Vec3& color) {
+        return Texel8{ curve.fromLinear8(color.r), curve.fromLinear8(color.g), curve.fromLinear8(color.b), 255 };
+    };
+
+    // Mips are computed from the linear colors, and then converted to the texture format
+    std::vector<Vec3> current = std::move(colors);
+    int levelW = w;
+    int levelH = h;
+    while (true) {
+
+        MipLevel level(levelW, levelH);
+        const int tilesY = (levelH + kTexelTileSize - 1) / kTexelTileSize;
+        const int texelCount = level.tilesX * tilesY * kTexelTileSize * kTexelTileSize;
+
+        // Rows of tiles are converted in parallel
+        ThreadPool& pool = DefaultThreadPool();
+        switch (format) {
+        case TextureFormat::RGB32F:
+            level.texelsRGB32F.resize(texelCount);
+            pool.parallelFor(tilesY, [&](int ty, int) {
+                for (int y = ty * kTexelTileSize; y < std::min((ty + 1) * kTexelTileSize, levelH); ++y) {
+                    for (int x = 0; x < levelW; ++x) {
+                        level.texelsRGB32F[level.texelIndex(x, y)] = current[y * levelW + x];
+                    }
+                }
+                });
+            break;
+        case TextureFormat::RGBA8:
+            level.texelsRGBA8.resize(texelCount);
+            pool.parallelFor(tilesY, [&](int ty, int) {
+                for (int y = ty * kTexelTileSize; y < std::min((ty + 1) * kTexelTileSize, levelH); ++y) {
+                    for (int x = 0; x < levelW; ++x) {
+                        level.texelsRGBA8[level.texelIndex(x, y)] = encode(current[y * levelW + x]);
+                    }
+                }
+                });
+            break;
+        case TextureFormat::BC1:
+            level.blocksBC1.resize(level.tilesX * tilesY);
+            pool.parallelFor(tilesY, [&](int by, int) {
+                for (int bx = 0; bx < level.tilesX; ++bx) {
+                    // Blocks on the border repeat the last row/column
+                    std::array<Texel8, 16> texels;
+                    for (int t = 0; t < 16; ++t) {
+                        const int x = std::min(bx * 4 + t % 4, levelW - 1);
+                        const int y = std::min(by * 4 + t / 4, levelH - 1);
+                        texels[t] = encode(current[y * levelW + x]);
+                    }
+                    level.blocksBC1[by * level.tilesX + bx] = EncodeBC1(texels);
+                }
+                });
+            break;
+        }
+        levels.push_back(std::move(level));
+
+        if (levelW == 1 && levelH == 1) {
+            break;
+        }
+        const int nextW = std::max(levelW / 2, 1);
+        const int nextH = std::max(levelH / 2, 1);
+        current = Downsample(current, levelW, levelH, nextW, nextH);
+        levelW = nextW;
+        levelH = nextH;
+    }
+}
+
+namespace {
+
+// Header of a PNM image: magic number, width, height and max value, separated by whitespace, with
+// comments from '#' to the end of the line. Binary data starts after a single whitespace.
+struct PnmHeader {
+    int channels;
+    bool ascii;
+    int w;
+    int h;
+    int maxValue;
+    size_t dataOffset;
+};
+
+class PnmParser {
+
+public:
+
+    PnmParser(const uint8_t* data_, size_t size_, size_t pos_ = 0) : data(data_), size(size_), pos(pos_) {}
 
-                uint16_t cVal = data[(y * w + x) * dataSize * 3 + dataSize * c];
-                if (dataSize == 2) {
-                    const uint16_t leastSig = data[(y * w + x) * dataSize * 3 + dataSize * c + 1];
-                    cVal = cVal * 256 + leastSig;
+    void skipSpaceAndComments() {
+        while (pos < size) {
+            if (data[pos] == '#') {
+                while (pos < size && data[pos] != '\n') {
+                    ++pos;
                 }
-                tex.colors[y * w + x][c] = powf(static_cast<float>(cVal) / maxV, gamma);
             }
+            else if (std::isspace(data[pos])) {
+                ++pos;
+            }
+            else {
+                break;
+            }
+        }
+    }
+
+    int readInt() {
+        skipSpaceAndComments();
+        if (pos >= size || !std::isdigit(data[pos])) {
+            throw std::runtime_error("ReadTexture: malformed file");
+        }
+        int64_t v = 0;
+        while (pos < size && std::isdigit(data[pos])) {
+            v = v * 10 + (data[pos++] - '0');
+            if (v > std::numeric_limits<int>::max()) {
+                throw std::runtime_error("ReadTexture: value out of range");
+            }
+        }
+        return static_cast<int>(v);
+    }
+
+    PnmHeader readHeader() {
+        if (size < 2 || data[0] != 'P') {
+            throw std::runtime_error("ReadTexture: wrong magic number");
+        }
+        PnmHeader header;
+        switch (data[1]) {
+        case '2': header.channels = 1; header.ascii = true; break;
+        case '3': header.channels = 3; header.ascii = true; break;
+        case '5': header.channels = 1; header.ascii = false; break;
+        case '6': header.channels = 3; header.ascii = false; break;
+        default:
+            throw std::runtime_error("ReadTexture: wrong magic number");
         }
+        pos = 2;
+        header.w = readInt();
+        header.h = readInt();
+        header.maxValue = readInt();
+        if (header.w <= 0 || header.h <= 0 || header.maxValue <= 0 || header.maxValue > 65535) {
+            throw std::runtime_error("ReadTexture: invalid header");
+        }
+        if (int64_t(header.w) * header.h > std::numeric_limits<int>::max()) {
+            throw std::runtime_error("ReadTexture: image too large");
+        }
+        if (pos >= size || !std::isspace(data[pos])) {
+            throw std::runtime_error("ReadTexture: malformed file");
+        }
+        header.dataOffset = pos + 1;
+        return header;
     }
 
-    return tex;
+private:
+
+    const uint8_t* data;
+    size_t size;
+    size_t pos;
+
+};
+
+// Convert rows [y0, y1) of binary data, with 1 or 3 channels of 1 or 2 bytes (big endian)
+template <int channels, int bytes>
+void ConvertRows(const uint8_t* data, int w, int y0, int y1, const std::vector<float>& toLinear, std::vector<Vec3>& colors) {
+
+    const int maxValue = static_cast<int>(toLinear.size()) - 1;
+    const float* table = toLinear.data();
+
+    for (int y = y0; y < y1; ++y) {
+        const uint8_t* row = data + size_t(y) * w * channels * bytes;
+        Vec3* out = colors.data() + size_t(y) * w;
+
+        int x = 0;
+#if defined(RASTERIZER_AVX2)
+        // 8 bit RGB: gather 8 channels at a time, with 0 to 255 always in the table
+        if constexpr (channels == 3 && bytes == 1) {
+            if (maxValue == 255) {
+                float* outFloats = &out[0][0];
+                static_assert(sizeof(Vec3) == 3 * sizeof(float));
+                for (; x + 8 <= w; x += 8) {
+                    for (int i = 0; i < 3; ++i) {
+                        const __m128i bytes8 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(row + x * 3 + i * 8));
+                        const __m256 v = _mm256_i32gather_ps(table, _mm256_cvtepu8_epi32(bytes8), 4);
+                        _mm256_storeu_ps(outFloats + x * 3 + i * 8, v);
+                    }
+                }
+            }
+        }
+#endif
+        for (; x < w; ++x) {
+            for (int c = 0; c < 3; ++c) {
+                const uint8_t* sample = row + (x * channels + (channels == 3 ? c : 0)) * bytes;
+                const int v = bytes == 2 ? sample[0] << 8 | sample[bytes - 1] : sample[0];
+                out[x][c] = table[std::min(v, maxValue)];
+            }
+        }
+    }
 }
 
+}
+
+// Read a texture from a ppm (P6, P3) or pgm (P5, P2) image. The file is mapped in memory and its
+// rows are converted in parallel.
+Texture ReadTexture(const std::string& filename, float gamma, TextureFormat format) {
+
+    const MappedFile file(filename);
+    const PnmHeader header = PnmParser(file.data(), file.size()).readHeader();
+    const int w = header.w;
+    const int h = header.h;
+
+    std::vector<Vec3> colors(size_t(w) * h);
+    const std::vector<float> toLinear = GammaCurve(gamma).toLinearTable(header.maxValue);
+
+    if (header.ascii) {
+        PnmParser parser(file.data(), file.size(), header.dataOffset);
+        for (Vec3& color : colors) {
+            for (int c = 0; c < 3; ++c) {
+                color[c] = c < header.channels ? toLinear[std::min(parser.readInt(), header.maxValue)] : color[0];
+            }
+        }
+    }
+    else {
+        const int bytes = header.maxValue < 256 ? 1 : 2;
+        if (file.size() - header.dataOffset < size_t(w) * h * header.channels * bytes) {
+            throw std::runtime_error("ReadTexture: file too short");
+        }
+        const uint8_t* data = file.data() + header.dataOffset;
+
+        constexpr int rowsPerJob = 16;
+        DefaultThreadPool().parallelFor((h + rowsPerJob - 1) / rowsPerJob, [&](int job, int) {
+            const int y0 = job * rowsPerJob;
+            const int y1 = std::min(y0 + rowsPerJob, h);
+            if (header.channels == 3) {
+                bytes == 1 ? ConvertRows<3, 1>(data, w, y0, y1, toLinear, colors) : ConvertRows<3, 2>(data, w, y0, y1, toLinear, colors);
+            }
+            else {
+                bytes == 1 ? ConvertRows<1, 1>(data, w, y0, y1, toLinear, colors) : ConvertRows<1, 2>(data, w, y0, y1, toLinear, colors);
+            }
+            });
+    }
+
+    return Texture(w, h, std::move(colors), format, gamma);
+}
@@ -0,0 +1,140 @@
+#include "threadpool.h"
+
+#include <algorithm>
+#include <exception>
+
+namespace {
+
+thread_local bool insideWorker = false;
+thread_local int workerIndex = 0;
+
+}
+
+ThreadPool::ThreadPool(int threads) {
+	threads = std::max(threads, 1);
+	for (int i = 1; i < threads; ++i) {
+		workers.emplace_back(&ThreadPool::workerLoop, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard lock(mutex);
+		stopping = true;
+	}
+	wakeCond.notify_all();
+	for (auto& t : workers) {
+		t.join();
+	}
+}
+
+void ThreadPool::runJob(int worker) {
+	for (int i = nextIndex++; i < jobCount; i = nextIndex++) {
+		job(i, worker);
+	}
+}
+
+int ThreadPool::currentWorker() {
+	return workerIndex;
+}
+
+void ThreadPool::workerLoop(int worker) {
+	insideWorker = true;
+	workerIndex = worker;
+	unsigned seen = 0;
+	while (true) {
+		{
+			std::unique_lock lock(mutex);
+			wakeCond.wait(lock, [&] { return stopping || generation != seen; });
+			if (stopping) {
+				return;
+			}
+			seen = generation;
+			if (worker >= jobWorkers) {
+				continue;
+			}
+			++busyWorkers;
+		}
+
+		// Exceptions are passed to the caller of run(), the remaining indices are skipped
+		std::exception_ptr jobError;
+		try {
+			runJob(worker);
+		}
+		catch (...) {
+			jobError = std::current_exception();
+			nextIndex = jobCount;
+		}
+
+		{
+			std::lock_guard lock(mutex);
+			if (jobError && !error) {
+				error = jobError;
+			}
+			--busyWorkers;
+		}
+		doneCond.notify_all();
+	}
+}
+
+void ThreadPool::run(int count, Job fn, int maxWorkers) {
+
+	if (count <= 0) {
+		return;
+	}
+
+	int nWorkers = maxWorkers > 0 ? std::min(maxWorkers, size()) : size();
+	nWorkers = std::min(nWorkers, count);
+
+	if (insideWorker || nWorkers == 1) {
+		for (int i = 0; i < count; ++i) {
+			fn(i, 0);
+		}
+		return;
+	}
+
+	std::lock_guard submitLock(submitMutex);
+	insideWorker = true;
+	{
+		std::lock_guard lock(mutex);
+		job = fn;
+		jobCount = count;
+		jobWorkers = nWorkers;
+		nextIndex = 0;
+		++generation;
+	}
+	wakeCond.notify_all();
+
+	std::exception_ptr jobError;
+	try {
+		runJob(0);
+	}
+	catch (...) {
+		jobError = std::current_exception();
+		nextIndex = jobCount;
+	}
+
+	{
+		// Workers that did not wake up yet will find no index left, but must not touch the job
+		// after it is gone, so wait until every worker has seen this generation. Even on errors:
+		// fn may reference the stack of the caller.
+		std::unique_lock lock(mutex);
+		doneCond.wait(lock, [&] { return busyWorkers == 0 && nextIndex >= jobCount; });
+		job = {};
+		jobWorkers = 0;
+		if (!jobError) {
+			jobError = error;
+		}
+		error = nullptr;
+	}
+	insideWorker = false;
+
+	if (jobError) {
+		std::rethrow_exception(jobError);
+	}
+}
+
+ThreadPool& DefaultThreadPool() {
+	static ThreadPool pool;
+	return pool;
+}
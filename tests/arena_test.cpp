@@ -0,0 +1,104 @@
+// Draws with a frame arena give the same image as with the heap, and an arena made for a smaller
+// pool than the draw's is reported by an exception on the calling thread.
+
+#include <cstdio>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include "check.h"
+#include "framebuffer.h"
+#include "arena.h"
+#include "pipeline.h"
+#include "commands.h"
+
+using FB = BasicFramebuffer<ColorRGBA8, Depth24, TiledLayout<8>>;
+
+constexpr int kWidth = 128;
+constexpr int kHeight = 96;
+
+int main() {
+
+	const std::vector<TestVertIn> triangles = RandomTriangles(300, 2);
+	const std::span<const TestVertIn> vertices(triangles);
+	const CubeVertShader vShader;
+	ThreadPool pool(4);
+
+	for (RasterMode mode : { RasterMode::Immediate, RasterMode::Streaming, RasterMode::Binned, RasterMode::Deferred }) {
+		DrawOptions options;
+		options.mode = mode;
+		options.pool = &pool;
+
+		FB heap(kWidth, kHeight);
+		heap.clear({ 0.f, 0.f, 0.f, 1.f });
+		DrawTriangles<OpaqueState>(heap, vertices, vShader, GradientShader{}, options);
+
+		// Twice, the second time from the blocks kept by reset()
+		FrameArena arena(pool);
+		options.arena = &arena;
+		FB arenaDrawn(kWidth, kHeight);
+		for (int frame = 0; frame < 2; ++frame) {
+			arena.reset();
+			arenaDrawn.clear({ 0.f, 0.f, 0.f, 1.f });
+			DrawTriangles<OpaqueState>(arenaDrawn, vertices, vShader, GradientShader{}, options);
+			CHECK(DifferentPixels(heap, arenaDrawn) == 0);
+		}
+		CHECK(arena.used() > 0);
+
+		// Fewer threads than the arenas is fine
+		options.threads = 2;
+		arena.reset();
+		arenaDrawn.clear({ 0.f, 0.f, 0.f, 1.f });
+		DrawTriangles<OpaqueState>(arenaDrawn, vertices, vShader, GradientShader{}, options);
+		CHECK(DifferentPixels(heap, arenaDrawn) == 0);
+	}
+
+	// An arena of a single worker with a pool of 4
+	ThreadPool single(1);
+	FrameArena small(single);
+	DrawOptions options;
+	options.mode = RasterMode::Binned;
+	options.pool = &pool;
+	options.arena = &small;
+	FB framebuffer(kWidth, kHeight);
+
+	bool thrown = false;
+	try {
+		DrawTriangles<OpaqueState>(framebuffer, vertices, vShader, GradientShader{}, options);
+	}
+	catch (const std::invalid_argument&) {
+		thrown = true;
+	}
+	CHECK(thrown);
+
+	std::vector<uint32_t> indices(triangles.size());
+	for (size_t i = 0; i < indices.size(); ++i) {
+		indices[i] = static_cast<uint32_t>(i);
+	}
+	thrown = false;
+	try {
+		DrawIndexedTriangles<OpaqueState>(framebuffer, vertices, std::span<const uint32_t>(indices), vShader, GradientShader{}, options);
+	}
+	catch (const std::invalid_argument&) {
+		thrown = true;
+	}
+	CHECK(thrown);
+
+	thrown = false;
+	CommandList<FB> commands;
+	commands.draw<OpaqueState>(vertices, vShader, GradientShader{});
+	try {
+		commands.submit(framebuffer, options);
+	}
+	catch (const std::invalid_argument&) {
+		thrown = true;
+	}
+	CHECK(thrown);
+
+	// Limited to the workers of the arena, it is enough
+	options.threads = 1;
+	DrawTriangles<OpaqueState>(framebuffer, vertices, vShader, GradientShader{}, options);
+	commands.submit(framebuffer, options);
+
+	return TestResult();
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+// Minimal checks for the tests: a failed CHECK prints where and what, and the test carries on so that
+// all the failures are reported. main() returns TestResult().
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <tuple>
+#include <vector>
+
+#include "vec.h"
+#include "mat.h"
+#include "vertex.h"
+
+inline int& CheckFailures() {
+	static int failures = 0;
+	return failures;
+}
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+			++CheckFailures(); \
+		} \
+	} while (0)
+
+inline int TestResult() {
+	if (CheckFailures() > 0) {
+		std::fprintf(stderr, "%d check(s) failed\n", CheckFailures());
+		return 1;
+	}
+	return 0;
+}
+
+using TestVertIn = std::tuple<Vec3, Vec2>;
+
+// Constant color, the texture coordinates are ignored
+struct ColorShader {
+	Vec4 color;
+	Vec4 operator()(Vec3, Vec2) const {
+		return color;
+	}
+};
+
+// Varying color, so that interpolation is compared too
+struct GradientShader {
+	float alpha = 1.f;
+	Vec4 operator()(Vec3, Vec2 tex) const {
+		return { tex.x, tex.y, 0.5f, alpha };
+	}
+};
+
+// Triangle with positions in NDC, at constant depth z
+inline void AddTriangle(std::vector<TestVertIn>& vertices, Vec2 a, Vec2 b, Vec2 c, float z) {
+	vertices.push_back({ Vec3{ a.x, a.y, z }, Vec2{ 0.f, 0.f } });
+	vertices.push_back({ Vec3{ b.x, b.y, z }, Vec2{ 1.f, 0.f } });
+	vertices.push_back({ Vec3{ c.x, c.y, z }, Vec2{ 0.f, 1.f } });
+}
+
+// Triangles of random sizes and depths, some partly off screen
+inline std::vector<TestVertIn> RandomTriangles(int count, unsigned seed) {
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> center(-1.1f, 1.1f);
+	std::uniform_real_distribution<float> offset(-0.4f, 0.4f);
+	std::uniform_real_distribution<float> depth(-0.9f, 0.9f);
+	std::vector<TestVertIn> vertices;
+	for (int i = 0; i < count; ++i) {
+		const Vec2 c = { center(rng), center(rng) };
+		for (int v = 0; v < 3; ++v) {
+			vertices.push_back({ Vec3{ c.x + offset(rng), c.y + offset(rng), depth(rng) }, Vec2{ v == 1 ? 1.f : 0.f, v == 2 ? 1.f : 0.f } });
+		}
+	}
+	return vertices;
+}
+
+// Pixels with some sample whose color or depth differ between a and b
+template <typename FB>
+int DifferentPixels(const FB& a, const FB& b) {
+	int different = 0;
+	for (int y = 0; y < a.h; ++y) {
+		for (int x = 0; x < a.w; ++x) {
+			for (int s = 0; s < FB::samples; ++s) {
+				const Vec4 ca = a.getColor(x, y, s);
+				const Vec4 cb = b.getColor(x, y, s);
+				if (ca.x != cb.x || ca.y != cb.y || ca.z != cb.z || ca.w != cb.w || a.getDepth(x, y, s) != b.getDepth(x, y, s)) {
+					++different;
+					break;
+				}
+			}
+		}
+	}
+	return different;
+}
+
+// Reference for draws with a perspective projection, the camera at the origin looking down -z (model
+// and view are the identity). Pixels are found by casting rays through their centers, in double.
+struct PerspectiveCamera {
+
+	int w;
+	int h;
+	float fovy = 1.5707964f;
+	float near = 0.5f;
+	float far = 20.f;
+
+	Mat4 projection() const {
+		return ::projection(fovy, static_cast<float>(w) / h, near, far);
+	}
+
+	// Triangle abc (in view space) hit by the ray through window point (x, y) between the near and
+	// far planes: t is the distance along -z, u and v the barycentrics of b and c
+	bool hit(const Vec3& a, const Vec3& b, const Vec3& c, double x, double y, double& t, double& u, double& v) const {
+		const double tanY = std::tan(fovy / 2.);
+		const double d[3] = { (x / w * 2. - 1.) * tanY * w / h, (y / h * 2. - 1.) * tanY, -1. };
+		const double e1[3] = { double(b.x) - a.x, double(b.y) - a.y, double(b.z) - a.z };
+		const double e2[3] = { double(c.x) - a.x, double(c.y) - a.y, double(c.z) - a.z };
+		const double s[3] = { -double(a.x), -double(a.y), -double(a.z) };
+		const auto cross = [](const double* p, const double* q, double* r) {
+			r[0] = p[1] * q[2] - p[2] * q[1];
+			r[1] = p[2] * q[0] - p[0] * q[2];
+			r[2] = p[0] * q[1] - p[1] * q[0];
+		};
+		const auto dot = [](const double* p, const double* q) {
+			return p[0] * q[0] + p[1] * q[1] + p[2] * q[2];
+		};
+		double p[3], q[3];
+		cross(d, e2, p);
+		const double det = dot(e1, p);
+		if (std::abs(det) < 1e-12) {
+			return false;
+		}
+		cross(s, e1, q);
+		u = dot(s, p) / det;
+		v = dot(d, q) / det;
+		t = dot(e2, q) / det;
+		return u >= 0. && v >= 0. && u + v <= 1. && t >= near && t <= far;
+	}
+
+	// Whether pixel (px, py) is covered. The rasterizer snaps the vertices to 1/16 of pixel, so
+	// ambiguous is set when the answer changes within that distance of the center.
+	bool covers(const Vec3& a, const Vec3& b, const Vec3& c, int px, int py, bool& ambiguous, double& t, double& u, double& v) const {
+		const bool center = hit(a, b, c, px + 0.5, py + 0.5, t, u, v);
+		ambiguous = false;
+		for (int i = 0; i < 8; ++i) {
+			const double angle = i * 3.14159265358979 / 4.;
+			double ot, ou, ov;
+			ambiguous = ambiguous || hit(a, b, c, px + 0.5 + std::cos(angle) / 16., py + 0.5 + std::sin(angle) / 16., ot, ou, ov) != center;
+		}
+		return center;
+	}
+
+	// Largest depth error expected at pixel (px, py), from the snapping of the vertices
+	double depthTolerance(const Vec3& a, const Vec3& b, const Vec3& c, int px, int py) const {
+		double t0, tx, ty, u, v;
+		hit(a, b, c, px + 0.5, py + 0.5, t0, u, v);
+		hit(a, b, c, px + 1.5, py + 0.5, tx, u, v);
+		hit(a, b, c, px + 0.5, py + 1.5, ty, u, v);
+		return 1e-6 + (std::abs(depth(tx) - depth(t0)) + std::abs(depth(ty) - depth(t0))) / 16.;
+	}
+
+	// Window depth of a point at distance t along -z
+	double depth(double t) const {
+		const double ndc = ((double(far) + near) * t - 2. * far * near) / ((double(far) - near) * t);
+		return ndc / 2. + 0.5;
+	}
+
+};
@@ -0,0 +1,97 @@
+// Clipping against known results: triangles seen through a perspective projection, crossing the
+// near plane, the far plane or the guard band, cover the pixels and have the depths found by casting
+// rays through the pixel centers.
+
+#include <cmath>
+#include <cstdio>
+#include <span>
+#include <vector>
+
+#include "check.h"
+#include "framebuffer.h"
+#include "pipeline.h"
+#include "stats.h"
+
+using FB = BasicFramebuffer<ColorRGBA32F, Depth32F>;
+
+constexpr RasterMode kModes[] = { RasterMode::Immediate, RasterMode::Streaming, RasterMode::Binned, RasterMode::Deferred };
+constexpr const char* kModeNames[] = { "immediate", "streaming", "binned", "deferred" };
+
+struct ClipCase {
+	const char* name;
+	Vec3 a, b, c;			// View space
+	bool clipped;			// Expected DrawStats
+	bool outside;
+	int minCovered;			// Pixels, so that the case tests something
+};
+
+int main() {
+
+	const PerspectiveCamera camera{ 160, 120 };
+	CubeVertShader vShader;
+	vShader.projection = camera.projection();
+
+	const ClipCase cases[] = {
+		// c is behind the camera
+		{ "near", { -1.f, -1.f, -4.f }, { 2.f, -0.5f, -3.f }, { 0.f, 0.8f, 1.f }, true, false, 2000 },
+		// b projects to hundreds of thousands of pixels to the right, out of the fixed point range
+		{ "guard_band", { -1.f, -1.f, -3.f }, { 30000.f, 0.2f, -3.f }, { -0.5f, 1.f, -5.f }, true, false, 2000 },
+		{ "far", { -3.f, -2.f, -10.f }, { 3.f, -2.f, -10.f }, { 0.f, 3.f, -40.f }, true, false, 200 },
+		// Near and far together, and the sides of the screen
+		{ "near_far", { -20.f, -1.f, -60.f }, { 20.f, -1.f, -60.f }, { 0.f, -1.f, 2.f }, true, false, 2000 },
+		{ "inside", { -1.f, -1.f, -3.f }, { 1.f, -1.f, -2.f }, { 0.f, 1.f, -4.f }, false, false, 500 },
+		{ "behind", { -1.f, -1.f, 1.f }, { 1.f, -1.f, 2.f }, { 0.f, 1.f, 3.f }, false, true, 0 },
+		{ "beyond_far", { -1.f, -1.f, -30.f }, { 1.f, -1.f, -30.f }, { 0.f, 1.f, -25.f }, false, true, 0 },
+	};
+
+	for (const ClipCase& test : cases) {
+		std::vector<TestVertIn> vertices;
+		for (const Vec3& p : { test.a, test.b, test.c }) {
+			vertices.push_back({ p, Vec2{ 0.f, 0.f } });
+		}
+
+		for (size_t m = 0; m < std::size(kModes); ++m) {
+			DrawOptions options;
+			options.mode = kModes[m];
+			FB framebuffer(camera.w, camera.h);
+			framebuffer.clear({ 0.f, 0.f, 0.f, 1.f });
+			const DrawStats stats = DrawTriangles<Instrumented<OpaqueState>>(framebuffer, std::span<const TestVertIn>(vertices), vShader,
+				ColorShader{ { 1.f, 1.f, 1.f, 1.f } }, options);
+			CHECK((stats.trianglesClipped == 1) == test.clipped);
+			CHECK((stats.trianglesOutside == 1) == test.outside);
+
+			int covered = 0;
+			int wrong = 0;
+			int wrongDepth = 0;
+			for (int py = 0; py < camera.h; ++py) {
+				for (int px = 0; px < camera.w; ++px) {
+					bool ambiguous;
+					double t, u, v;
+					const bool expected = camera.covers(test.a, test.b, test.c, px, py, ambiguous, t, u, v);
+					const bool drawn = framebuffer.getColor(px, py).x == 1.f;
+					if (ambiguous) {
+						continue;
+					}
+					if (drawn != expected) {
+						++wrong;
+					}
+					else if (drawn) {
+						++covered;
+						if (std::abs(framebuffer.getDepth(px, py) - camera.depth(t)) > camera.depthTolerance(test.a, test.b, test.c, px, py)) {
+							++wrongDepth;
+						}
+					}
+				}
+			}
+
+			if (wrong != 0 || wrongDepth != 0 || covered < test.minCovered) {
+				std::fprintf(stderr, "%s, %s: %d pixels covered, %d wrong, %d at a wrong depth\n", test.name, kModeNames[m], covered, wrong, wrongDepth);
+			}
+			CHECK(wrong == 0);
+			CHECK(wrongDepth == 0);
+			CHECK(covered >= test.minCovered);
+		}
+	}
+
+	return TestResult();
+}
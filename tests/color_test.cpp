@@ -0,0 +1,76 @@
+// ColorCurve: 8 bit round trips, accuracy of fromLinear() against the exact curves, and the SIMD
+// encoding against the scalar one, out of range values and NaN included.
+
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "check.h"
+#include "color.h"
+
+static float SRGBFromLinearExact(float v) {
+	return v <= 0.0031308f ? v * 12.92f : 1.055f * std::pow(v, 1.f / 2.4f) - 0.055f;
+}
+
+static void CheckCurve(const char* name, const ColorCurve& curve, float (*exact)(float), float maxError) {
+
+	// Every code decodes and encodes back to itself
+	int mismatches = 0;
+	for (int c = 0; c < 256; ++c) {
+		if (curve.fromLinear8(curve.toLinear8(static_cast<uint8_t>(c))) != c) {
+			++mismatches;
+		}
+	}
+	if (mismatches != 0) {
+		std::fprintf(stderr, "%s: %d codes don't round trip\n", name, mismatches);
+	}
+	CHECK(mismatches == 0);
+
+	float error = 0.f;
+	for (int i = 0; i <= 100000; ++i) {
+		const float v = i / 100000.f;
+		error = std::max(error, std::abs(curve.fromLinear(v) - exact(v)));
+	}
+	if (error > maxError) {
+		std::fprintf(stderr, "%s: max error %g\n", name, error);
+	}
+	CHECK(error <= maxError);
+
+	// Out of range and non finite values are clamped, NaN encodes to 0
+	constexpr float inf = std::numeric_limits<float>::infinity();
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+	CHECK(curve.fromLinear(nan) == 0.f);
+	CHECK(curve.fromLinear(-nan) == 0.f);
+	CHECK(curve.fromLinear(-1.f) == 0.f);
+	CHECK(curve.fromLinear(-inf) == 0.f);
+	CHECK(curve.fromLinear8(2.f) == 255);
+	CHECK(curve.fromLinear8(inf) == 255);
+
+	// The SIMD encoding gives the same codes as the scalar one
+	std::vector<float> values = { nan, -nan, -inf, inf, -1.f, 0.f, 1e-30f, 1e-7f, 0.5f, 1.f, 1.5f, 1e30f };
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> dist(-0.1f, 1.1f);
+	for (int i = 0; i < 1000; ++i) {
+		values.push_back(dist(rng));
+	}
+	std::vector<uint8_t> codes(values.size());
+	curve.fromLinear8(values.data(), static_cast<int>(values.size()), codes.data());
+	mismatches = 0;
+	for (size_t i = 0; i < values.size(); ++i) {
+		if (codes[i] != curve.fromLinear8(values[i])) {
+			++mismatches;
+		}
+	}
+	if (mismatches != 0) {
+		std::fprintf(stderr, "%s: %d values encode differently with SIMD\n", name, mismatches);
+	}
+	CHECK(mismatches == 0);
+}
+
+int main() {
+	CheckCurve("srgb", SRGBCurve(), SRGBFromLinearExact, 2.5e-5f);
+	CheckCurve("gamma_2.2", GammaCurve(2.2f), [](float v) { return std::pow(v, 1.f / 2.2f); }, 6e-4f);
+	return TestResult();
+}
@@ -0,0 +1,136 @@
+// CommandList::submit against the same draws made one by one, in every raster mode: reordering the
+// draws must not change the image.
+
+#include <cstdio>
+#include <span>
+#include <vector>
+
+#include "check.h"
+#include "vec.h"
+#include "vertex.h"
+#include "framebuffer.h"
+#include "pipeline.h"
+#include "commands.h"
+
+using FB = BasicFramebuffer<ColorRGBA8, Depth24, TiledLayout<8>>;
+
+constexpr int kWidth = 128;
+constexpr int kHeight = 96;
+
+using LessEqualState = PipelineState<DepthFunc::LessEqual, true, BlendMode::None>;
+using RedOnlyState = PipelineState<DepthFunc::Less, true, BlendMode::None, kColorMaskR>;
+
+constexpr RasterMode kModes[] = { RasterMode::Immediate, RasterMode::Streaming, RasterMode::Binned, RasterMode::Deferred };
+constexpr const char* kModeNames[] = { "immediate", "streaming", "binned", "deferred" };
+
+// Draws made right away, with the interface of CommandList
+struct SeparateDraws {
+
+	FB& framebuffer;
+	DrawOptions options;
+
+	template <typename State, typename VertAttr, typename Vert, typename Frag>
+	void draw(std::span<VertAttr> vertices, Vert vShader, Frag fShader) {
+		DrawTriangles<State>(framebuffer, vertices, vShader, fShader, options);
+	}
+
+	template <typename State, typename VertAttr, typename Vert, typename Frag>
+	void drawIndexed(std::span<VertAttr> vertices, std::span<const uint32_t> indices, Vert vShader, Frag fShader) {
+		DrawIndexedTriangles<State>(framebuffer, vertices, indices, vShader, fShader, options);
+	}
+
+};
+
+// Pixels differing between record(draws) made one by one and from a command list, in each mode
+template <typename Record>
+void CompareWithSeparateDraws(const char* name, Record&& record) {
+	for (size_t m = 0; m < std::size(kModes); ++m) {
+		DrawOptions options;
+		options.mode = kModes[m];
+
+		FB separate(kWidth, kHeight);
+		separate.clear({ 0.f, 0.f, 0.f, 1.f });
+		SeparateDraws draws{ separate, options };
+		record(draws);
+
+		FB listed(kWidth, kHeight);
+		listed.clear({ 0.f, 0.f, 0.f, 1.f });
+		CommandList<FB> commands;
+		record(commands);
+		commands.submit(listed, options);
+
+		const int different = DifferentPixels(separate, listed);
+		if (different != 0) {
+			std::fprintf(stderr, "%s, %s: %d pixels differ\n", name, kModeNames[m], different);
+		}
+		CHECK(different == 0);
+	}
+}
+
+int main() {
+
+	const CubeVertShader vShader;
+
+	// Screen covering quads and a triangle in the middle, at various depths (NDC, nearer below)
+	std::vector<TestVertIn> farQuad, nearQuad, nearTriangle;
+	AddTriangle(farQuad, { -1.f, -1.f }, { 1.f, -1.f }, { 1.f, 1.f }, 0.5f);
+	AddTriangle(farQuad, { -1.f, -1.f }, { 1.f, 1.f }, { -1.f, 1.f }, 0.5f);
+	AddTriangle(nearQuad, { -1.f, -1.f }, { 1.f, -1.f }, { 1.f, 1.f }, -0.5f);
+	AddTriangle(nearQuad, { -1.f, -1.f }, { 1.f, 1.f }, { -1.f, 1.f }, -0.5f);
+	AddTriangle(nearTriangle, { -0.5f, -0.5f }, { 0.5f, -0.5f }, { 0.f, 0.5f }, -0.8f);
+
+	const ColorShader green{ { 0.f, 1.f, 0.f, 1.f } };
+	const ColorShader red{ { 1.f, 0.f, 0.f, 1.f } };
+	const ColorShader blue{ { 0.f, 0.f, 1.f, 1.f } };
+	const ColorShader translucent{ { 1.f, 1.f, 1.f, 0.5f } };
+
+	// Depth prepass with an occluder only drawn in it, then a LessEqual color pass. The color draw
+	// behind the occluder is nearer than the prepass elsewhere, so sorting by depth would move it first.
+	std::vector<TestVertIn> prepass = farQuad, hidden;
+	AddTriangle(prepass, { -0.6f, -0.6f }, { 0.6f, -0.6f }, { 0.f, 0.6f }, -0.3f);
+	AddTriangle(hidden, { -0.4f, -0.4f }, { 0.4f, -0.4f }, { 0.f, 0.4f }, 0.f);
+	AddTriangle(hidden, { 0.7f, 0.7f }, { 0.9f, 0.7f }, { 0.8f, 0.9f }, -0.8f);
+	CompareWithSeparateDraws("prepass", [&](auto& draws) {
+		draws.template draw<DepthOnlyState>(std::span<const TestVertIn>(prepass), vShader, green);
+		draws.template draw<LessEqualState>(std::span<const TestVertIn>(farQuad), vShader, red);
+		draws.template draw<LessEqualState>(std::span<const TestVertIn>(hidden), vShader, green);
+		});
+
+	// A depth-only draw nearer than the color draw before it must not hide it
+	CompareWithSeparateDraws("depth_only_after_color", [&](auto& draws) {
+		draws.template draw<LessEqualState>(std::span<const TestVertIn>(farQuad), vShader, green);
+		draws.template draw<DepthOnlyState>(std::span<const TestVertIn>(nearQuad), vShader, green);
+		draws.template draw<OpaqueState>(std::span<const TestVertIn>(nearTriangle), vShader, blue);
+		});
+
+	// A masked draw keeps the other channels of the draws before it
+	CompareWithSeparateDraws("color_masked", [&](auto& draws) {
+		draws.template draw<OpaqueState>(std::span<const TestVertIn>(farQuad), vShader, green);
+		draws.template draw<RedOnlyState>(std::span<const TestVertIn>(nearQuad), vShader, red);
+		draws.template draw<OpaqueState>(std::span<const TestVertIn>(nearTriangle), vShader, blue);
+		});
+
+	// Random opaque draws, reordered, and blended ones between them
+	const std::vector<TestVertIn> triangles = RandomTriangles(400, 1);
+	std::vector<uint32_t> indices(triangles.size());
+	for (size_t i = 0; i < indices.size(); ++i) {
+		indices[i] = static_cast<uint32_t>(indices.size() - 1 - i);
+	}
+	CompareWithSeparateDraws("mixed", [&](auto& draws) {
+		const std::span<const TestVertIn> vertices(triangles);
+		const std::span<const uint32_t> reversed(indices);
+		constexpr size_t drawVertices = 60;
+		for (size_t start = 0, i = 0; start < vertices.size(); start += drawVertices, ++i) {
+			const size_t n = std::min(drawVertices, vertices.size() - start);
+			if (i % 5 == 4) {
+				draws.template draw<DefaultState>(vertices.subspan(start, n), vShader, translucent);
+			} else if (i % 2 == 0) {
+				draws.template draw<OpaqueState>(vertices.subspan(start, n), vShader, GradientShader{});
+			} else {
+				draws.template drawIndexed<OpaqueState>(vertices, reversed.subspan(start, n), vShader, GradientShader{});
+			}
+		}
+		});
+
+	return TestResult();
+}
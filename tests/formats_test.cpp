@@ -0,0 +1,61 @@
+// Storage formats: depths at and next to the ends of [0, 1] stay in the range of their format, and
+// NaN is stored as 0.
+
+#include <cmath>
+#include <cstdio>
+#include <limits>
+
+#include "check.h"
+#include "format.h"
+#include "framebuffer.h"
+
+template <typename Depth>
+void CheckDepthFormat(const char* name, double maxStored) {
+
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+	const float values[] = { 0.f, std::nextafter(0.f, 1.f), -0.f, -1.f, std::nextafter(1.f, 0.f), 1.f, std::nextafter(1.f, 2.f), 2.f };
+	for (float v : values) {
+		const auto stored = Depth::encode(v);
+		const float decoded = Depth::decode(stored);
+		const bool inRange = static_cast<double>(stored) <= maxStored && decoded >= 0.f && decoded <= 1.f;
+		if (!inRange) {
+			std::fprintf(stderr, "%s: %.9g stored as %.9g, decoded to %.9g\n", name, v, static_cast<double>(stored), decoded);
+		}
+		CHECK(inRange || (std::is_floating_point_v<typename Depth::Storage> && (v < 0.f || v > 1.f)));
+	}
+
+	// The ends of the range are exact
+	CHECK(Depth::decode(Depth::encode(0.f)) == 0.f);
+	CHECK(Depth::decode(Depth::encode(1.f)) == 1.f);
+	CHECK(static_cast<double>(Depth::encode(1.f)) == maxStored);
+	CHECK(Depth::encode(std::nextafter(1.f, 0.f)) <= Depth::encode(1.f));
+
+	if constexpr (!std::is_floating_point_v<typename Depth::Storage>) {
+		CHECK(Depth::encode(nan) == 0);
+		CHECK(Depth::encode(-1.f) == 0);
+		CHECK(Depth::encode(2.f) == Depth::encode(1.f));
+	}
+
+	// What clear() stores
+	BasicFramebuffer<ColorRGBA8, Depth> framebuffer(4, 4);
+	framebuffer.clear();
+	CHECK(static_cast<double>(framebuffer.depths[0]) == maxStored);
+	CHECK(framebuffer.getDepth(3, 3) == 1.f);
+}
+
+int main() {
+
+	CheckDepthFormat<Depth32F>("depth32f", 1.);
+	CheckDepthFormat<Depth16>("depth16", 65535.);
+	CheckDepthFormat<Depth24>("depth24", 16777215.);
+
+	// Color channels round to the nearest code, NaN to 0
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+	CHECK(QuantizeUnorm<8>(nan) == 0);
+	CHECK(QuantizeUnorm<8>(0.5f) == 128);
+	CHECK(QuantizeUnorm<8>(1.f) == 255);
+	CHECK(QuantizeUnorm<10>(std::nextafter(1.f, 2.f)) == 1023);
+	CHECK(QuantizeUnorm<2>(-0.5f) == 0);
+
+	return TestResult();
+}
@@ -0,0 +1,402 @@
+// Image writers round trip: images written in each format are read back and compared. PPM files are
+// read with ReadTexture, PNG files with a small decoder below, which only supports what EncodePNG
+// writes (8 bit RGB, stored and fixed Huffman deflate blocks), checksums included.
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "output.h"
+#include "texture.h"
+
+namespace {
+
+std::vector<uint8_t> ReadFile(const std::string& filename) {
+	std::ifstream is(filename, std::ios::binary);
+	if (!is) {
+		throw std::runtime_error("ReadFile: can't open file");
+	}
+	return std::vector<uint8_t>(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+}
+
+uint32_t BigEndian32(const uint8_t* p) {
+	return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3];
+}
+
+uint32_t Crc32(const uint8_t* data, size_t size) {
+	uint32_t crc = ~0u;
+	for (size_t i = 0; i < size; ++i) {
+		crc ^= data[i];
+		for (int k = 0; k < 8; ++k) {
+			crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+		}
+	}
+	return ~crc;
+}
+
+uint32_t Adler32(const std::vector<uint8_t>& data) {
+	uint32_t a = 1, b = 0;
+	for (uint8_t byte : data) {
+		a = (a + byte) % 65521;
+		b = (b + a) % 65521;
+	}
+	return b << 16 | a;
+}
+
+// Deflate bit stream, least significant bit first
+class BitReader {
+
+public:
+
+	BitReader(const std::vector<uint8_t>& data_, size_t start, size_t end_) : data(data_), pos(start * 8), end(end_ * 8) {}
+
+	uint32_t bits(int n) {
+		uint32_t v = 0;
+		for (int i = 0; i < n; ++i) {
+			v |= bit() << i;
+		}
+		return v;
+	}
+
+	// Huffman codes are packed most significant bit first
+	uint32_t code(int n) {
+		uint32_t v = 0;
+		for (int i = 0; i < n; ++i) {
+			v = v << 1 | bit();
+		}
+		return v;
+	}
+
+	void alignByte() {
+		pos = (pos + 7) & ~size_t(7);
+	}
+
+	size_t bytePos() const {
+		return pos / 8;
+	}
+
+private:
+
+	uint32_t bit() {
+		if (pos >= end) {
+			throw std::runtime_error("Inflate: unexpected end of data");
+		}
+		const uint32_t v = (data[pos / 8] >> (pos % 8)) & 1;
+		++pos;
+		return v;
+	}
+
+	const std::vector<uint8_t>& data;
+	size_t pos;
+	size_t end;
+
+};
+
+// Literal/length symbol with the fixed Huffman codes
+uint32_t FixedLiteral(BitReader& reader) {
+	uint32_t code = reader.code(7);
+	if (code <= 23) {
+		return 256 + code;
+	}
+	code = code << 1 | reader.code(1);
+	if (code >= 48 && code <= 191) {
+		return code - 48;
+	}
+	if (code >= 192 && code <= 199) {
+		return 280 + code - 192;
+	}
+	code = code << 1 | reader.code(1);
+	return 144 + code - 400;
+}
+
+// zlib stream to its data
+std::vector<uint8_t> Inflate(const std::vector<uint8_t>& zlib) {
+
+	static constexpr uint16_t lengthBase[] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	static constexpr uint8_t lengthExtra[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	static constexpr uint16_t distBase[] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	static constexpr uint8_t distExtra[] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+	if (zlib.size() < 6 || (zlib[0] & 0x0f) != 8 || (zlib[0] * 256 + zlib[1]) % 31 != 0) {
+		throw std::runtime_error("Inflate: bad zlib header");
+	}
+
+	std::vector<uint8_t> out;
+	BitReader reader(zlib, 2, zlib.size() - 4);
+	bool last = false;
+	while (!last) {
+		last = reader.bits(1);
+		const uint32_t type = reader.bits(2);
+		if (type == 0) {
+			reader.alignByte();
+			const uint32_t len = reader.bits(16);
+			const uint32_t nlen = reader.bits(16);
+			if ((len ^ nlen) != 0xffff) {
+				throw std::runtime_error("Inflate: bad stored block length");
+			}
+			for (uint32_t i = 0; i < len; ++i) {
+				out.push_back(static_cast<uint8_t>(reader.bits(8)));
+			}
+		}
+		else if (type == 1) {
+			while (true) {
+				const uint32_t symbol = FixedLiteral(reader);
+				if (symbol < 256) {
+					out.push_back(static_cast<uint8_t>(symbol));
+					continue;
+				}
+				if (symbol == 256) {
+					break;
+				}
+				if (symbol > 285) {
+					throw std::runtime_error("Inflate: bad length symbol");
+				}
+				const uint32_t length = lengthBase[symbol - 257] + reader.bits(lengthExtra[symbol - 257]);
+				const uint32_t distSymbol = reader.code(5);
+				if (distSymbol > 29) {
+					throw std::runtime_error("Inflate: bad distance symbol");
+				}
+				const uint32_t dist = distBase[distSymbol] + reader.bits(distExtra[distSymbol]);
+				if (dist > out.size()) {
+					throw std::runtime_error("Inflate: distance too far back");
+				}
+				for (uint32_t i = 0; i < length; ++i) {
+					out.push_back(out[out.size() - dist]);
+				}
+			}
+		}
+		else {
+			throw std::runtime_error("Inflate: unsupported block type");
+		}
+	}
+
+	reader.alignByte();
+	if (BigEndian32(&zlib[zlib.size() - 4]) != Adler32(out)) {
+		throw std::runtime_error("Inflate: bad checksum");
+	}
+	return out;
+}
+
+int Paeth(int a, int b, int c) {
+	const int p = a + b - c;
+	const int pa = std::abs(p - a);
+	const int pb = std::abs(p - b);
+	const int pc = std::abs(p - c);
+	return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
+
+Image DecodePNG(const std::vector<uint8_t>& png) {
+
+	static constexpr uint8_t signature[] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	if (png.size() < 8 || !std::equal(std::begin(signature), std::end(signature), png.begin())) {
+		throw std::runtime_error("DecodePNG: bad signature");
+	}
+
+	Image image;
+	std::vector<uint8_t> zlib;
+	bool ended = false;
+	for (size_t pos = 8; !ended;) {
+		if (pos + 12 > png.size()) {
+			throw std::runtime_error("DecodePNG: truncated chunk");
+		}
+		const uint32_t length = BigEndian32(&png[pos]);
+		if (pos + 12 + length > png.size()) {
+			throw std::runtime_error("DecodePNG: truncated chunk");
+		}
+		const std::string type(png.begin() + pos + 4, png.begin() + pos + 8);
+		const uint8_t* data = &png[pos + 8];
+		if (Crc32(&png[pos + 4], length + 4) != BigEndian32(data + length)) {
+			throw std::runtime_error("DecodePNG: bad chunk CRC");
+		}
+		if (type == "IHDR") {
+			if (length != 13 || data[8] != 8 || data[9] != 2 || data[12] != 0) {
+				throw std::runtime_error("DecodePNG: only 8 bit RGB, not interlaced");
+			}
+			image.resize(static_cast<int>(BigEndian32(data)), static_cast<int>(BigEndian32(data + 4)));
+		}
+		else if (type == "IDAT") {
+			zlib.insert(zlib.end(), data, data + length);
+		}
+		else if (type == "IEND") {
+			ended = true;
+		}
+		pos += 12 + length;
+	}
+
+	const std::vector<uint8_t> filtered = Inflate(zlib);
+	const size_t stride = size_t(image.w) * 3;
+	if (filtered.size() != (stride + 1) * image.h) {
+		throw std::runtime_error("DecodePNG: bad image data size");
+	}
+	for (int y = 0; y < image.h; ++y) {
+		const uint8_t* in = &filtered[y * (stride + 1)];
+		uint8_t* row = image.row(y);
+		const uint8_t* prev = y > 0 ? image.row(y - 1) : nullptr;
+		for (size_t i = 0; i < stride; ++i) {
+			const int a = i >= 3 ? row[i - 3] : 0;
+			const int b = prev ? prev[i] : 0;
+			const int c = prev && i >= 3 ? prev[i - 3] : 0;
+			int predicted = 0;
+			switch (in[0]) {
+			case 0: predicted = 0; break;
+			case 1: predicted = a; break;
+			case 2: predicted = b; break;
+			case 3: predicted = (a + b) / 2; break;
+			case 4: predicted = Paeth(a, b, c); break;
+			default: throw std::runtime_error("DecodePNG: bad filter");
+			}
+			row[i] = static_cast<uint8_t>(in[1 + i] + predicted);
+		}
+	}
+	return image;
+}
+
+// Rows of noise, of runs, of gradients and repeated rows, for the filters and the matches
+Image TestImage(int w, int h, unsigned seed) {
+	Image image;
+	image.resize(w, h);
+	std::mt19937 rng(seed);
+	for (int y = 0; y < h; ++y) {
+		uint8_t* row = image.row(y);
+		for (int i = 0; i < w * 3; ++i) {
+			switch (y % 4) {
+			case 0: row[i] = static_cast<uint8_t>(rng()); break;
+			case 1: row[i] = static_cast<uint8_t>(i / 30 * 17); break;
+			case 2: row[i] = static_cast<uint8_t>(i + y); break;
+			default: row[i] = image.row(y - 1)[i]; break;
+			}
+		}
+	}
+	return image;
+}
+
+bool SamePixels(const Image& a, const Image& b) {
+	return a.w == b.w && a.h == b.h && a.rgb == b.rgb;
+}
+
+// Write image in format and read it back
+void CheckRoundTrip(const Image& image, ImageFormat format, const std::string& filename) {
+	try {
+		WriteImage(filename, image, format);
+		Image read;
+		switch (format) {
+		case ImageFormat::PPM: {
+			// 8 bit texels keep the encoded values, which round trip through linear
+			const Texture texture = ReadTexture(filename, 2.2f, TextureFormat::RGBA8);
+			const MipLevel& level = texture.levels[0];
+			read.resize(level.w, level.h);
+			for (int y = 0; y < level.h; ++y) {
+				for (int x = 0; x < level.w; ++x) {
+					const auto& texel = level.texelsRGBA8[level.texelIndex(x, y)];
+					std::copy_n(texel.begin(), 3, read.row(y) + x * 3);
+				}
+			}
+			break;
+		}
+		case ImageFormat::PNG:
+		case ImageFormat::PNGStored:
+			read = DecodePNG(ReadFile(filename));
+			break;
+		case ImageFormat::Raw:
+			read.w = image.w;
+			read.h = image.h;
+			read.rgb = ReadFile(filename);
+			break;
+		}
+		if (!SamePixels(image, read)) {
+			std::fprintf(stderr, "%s: read back differently\n", filename.c_str());
+		}
+		CHECK(SamePixels(image, read));
+	}
+	catch (const std::exception& e) {
+		std::fprintf(stderr, "%s: %s\n", filename.c_str(), e.what());
+		CHECK(false);
+	}
+	std::remove(filename.c_str());
+}
+
+}
+
+int main() {
+
+	CHECK(ImageFormatFromFilename("a.png") == ImageFormat::PNG);
+	CHECK(ImageFormatFromFilename("a.raw") == ImageFormat::Raw);
+	CHECK(ImageFormatFromFilename("a.rgb") == ImageFormat::Raw);
+	CHECK(ImageFormatFromFilename("a.ppm") == ImageFormat::PPM);
+	CHECK(ImageFormatFromFilename("png") == ImageFormat::PPM);
+
+	const std::pair<ImageFormat, const char*> formats[] = {
+		{ ImageFormat::PPM, "ppm" },
+		{ ImageFormat::PNG, "png" },
+		{ ImageFormat::PNGStored, "stored.png" },
+		{ ImageFormat::Raw, "raw" },
+	};
+	// Odd sizes, and a size whose stored PNG takes several deflate blocks
+	for (const auto& [w, h] : { std::pair{ 1, 1 }, std::pair{ 37, 23 }, std::pair{ 400, 150 } }) {
+		const Image image = TestImage(w, h, static_cast<unsigned>(w * h));
+		for (const auto& [format, extension] : formats) {
+			CheckRoundTrip(image, format, "images_test_" + std::to_string(w) + "x" + std::to_string(h) + "." + extension);
+		}
+	}
+
+	// Framebuffers are flipped: their first row is the bottom one
+	BasicFramebuffer<ColorRGBA8, Depth24, TiledLayout<8>> framebuffer(21, 13);
+	for (int y = 0; y < framebuffer.h; ++y) {
+		for (int x = 0; x < framebuffer.w; ++x) {
+			framebuffer.setColor(x, y, { x / 255.f, y / 255.f, (x + y) / 255.f, 1.f });
+		}
+	}
+	AsyncImageWriter writer;
+	writer.write("images_test_framebuffer.png", framebuffer);
+	writer.wait();
+	try {
+		const Image read = DecodePNG(ReadFile("images_test_framebuffer.png"));
+		bool same = read.w == framebuffer.w && read.h == framebuffer.h;
+		for (int y = 0; same && y < read.h; ++y) {
+			for (int x = 0; x < read.w; ++x) {
+				const uint8_t* pixel = &read.rgb[(size_t(framebuffer.h - 1 - y) * read.w + x) * 3];
+				same = same && pixel[0] == x && pixel[1] == y && pixel[2] == x + y;
+			}
+		}
+		CHECK(same);
+	}
+	catch (const std::exception& e) {
+		std::fprintf(stderr, "images_test_framebuffer.png: %s\n", e.what());
+		CHECK(false);
+	}
+	std::remove("images_test_framebuffer.png");
+
+	// Scratch row buffers give the same images, and are reused when the width doesn't grow
+	ImageScratch scratch;
+	ThreadPool pool(3);
+	for (const ColorCurve* curve : { static_cast<const ColorCurve*>(nullptr), &SRGBCurve() }) {
+		std::vector<const std::byte*> buffers;
+		for (int w : { 40, 40, 17 }) {
+			BasicFramebuffer<ColorRGBA32F, Depth32F> colors(w, 9);
+			for (int y = 0; y < colors.h; ++y) {
+				for (int x = 0; x < colors.w; ++x) {
+					colors.setColor(x, y, { x / 40.f, y / 9.f, 1.2f - x / 40.f, 1.f });
+				}
+			}
+			Image expected, converted;
+			ToImage(colors, expected, curve, &pool);
+			ToImage(colors, converted, curve, &pool, &scratch);
+			CHECK(SamePixels(expected, converted));
+
+			std::vector<const std::byte*> current;
+			for (const ImageScratch::Rows& rows : scratch.workers) {
+				current.push_back(rows.stored.data());
+			}
+			CHECK(scratch.workers.size() == 3);
+			CHECK(buffers.empty() || current == buffers);
+			buffers = current;
+		}
+	}
+
+	return TestResult();
+}
@@ -0,0 +1,107 @@
+// The raster modes draw the same image: every mode against the immediate one, with various tile
+// sizes, thread counts and layouts, opaque, blended, culled and indexed draws, and multisampled.
+
+#include <cstdio>
+#include <span>
+#include <vector>
+
+#include "check.h"
+#include "framebuffer.h"
+#include "pipeline.h"
+
+constexpr int kWidth = 160;
+constexpr int kHeight = 100;
+
+constexpr RasterMode kModes[] = { RasterMode::Immediate, RasterMode::Streaming, RasterMode::Binned, RasterMode::Deferred };
+constexpr const char* kModeNames[] = { "immediate", "streaming", "binned", "deferred" };
+
+// draw(framebuffer, options) in each mode, compared to the first one
+template <typename FB, typename DrawFn>
+void CompareModes(const char* name, DrawOptions options, DrawFn&& draw) {
+
+	FB reference(kWidth, kHeight);
+	reference.clear({ 0.f, 0.f, 0.f, 1.f });
+	options.mode = kModes[0];
+	draw(reference, options);
+
+	// Something was drawn
+	FB cleared(kWidth, kHeight);
+	cleared.clear({ 0.f, 0.f, 0.f, 1.f });
+	CHECK(DifferentPixels(reference, cleared) > kWidth * kHeight / 2);
+
+	for (size_t m = 1; m < std::size(kModes); ++m) {
+		FB framebuffer(kWidth, kHeight);
+		framebuffer.clear({ 0.f, 0.f, 0.f, 1.f });
+		options.mode = kModes[m];
+		draw(framebuffer, options);
+
+		const int different = DifferentPixels(reference, framebuffer);
+		if (different != 0) {
+			std::fprintf(stderr, "%s, %s: %d pixels differ from %s\n", name, kModeNames[m], different, kModeNames[0]);
+		}
+		CHECK(different == 0);
+	}
+}
+
+int main() {
+
+	using FB = BasicFramebuffer<ColorRGBA8, Depth24, TiledLayout<8>>;
+	using LinearFB = BasicFramebuffer<ColorRGBA32F, Depth32F>;
+	using Multisampled = BasicFramebuffer<ColorRGBA8, Depth24, TiledLayout<8>, 4>;
+	using CulledState = PipelineState<DepthFunc::Less, true, BlendMode::None, kColorMaskAll, CullMode::Back>;
+
+	const std::vector<TestVertIn> triangles = RandomTriangles(500, 3);
+	const std::span<const TestVertIn> vertices(triangles);
+	const CubeVertShader vShader;
+	ThreadPool pool(4);
+
+	std::vector<uint32_t> indices;
+	for (uint32_t i = 0; i < triangles.size(); i += 3) {
+		// Each triangle twice, the second time at the end
+		indices.insert(indices.end(), { i, i + 1, i + 2 });
+	}
+	indices.insert(indices.end(), indices.begin(), indices.end());
+
+	for (int tileSize : { 8, 64, 100 }) {
+		for (int threads : { 1, 4 }) {
+			DrawOptions options;
+			options.pool = &pool;
+			options.tileSize = tileSize;
+			options.threads = threads;
+			char name[64];
+
+			std::snprintf(name, sizeof(name), "opaque tiles %d threads %d", tileSize, threads);
+			CompareModes<FB>(name, options, [&](FB& framebuffer, const DrawOptions& drawOptions) {
+				DrawTriangles<OpaqueState>(framebuffer, vertices, vShader, GradientShader{}, drawOptions);
+				});
+
+			std::snprintf(name, sizeof(name), "blended tiles %d threads %d", tileSize, threads);
+			CompareModes<FB>(name, options, [&](FB& framebuffer, const DrawOptions& drawOptions) {
+				DrawTriangles<DefaultState>(framebuffer, vertices, vShader, GradientShader{ 0.5f }, drawOptions);
+				});
+
+			std::snprintf(name, sizeof(name), "indexed tiles %d threads %d", tileSize, threads);
+			CompareModes<FB>(name, options, [&](FB& framebuffer, const DrawOptions& drawOptions) {
+				DrawIndexedTriangles<OpaqueState>(framebuffer, vertices, std::span<const uint32_t>(indices), vShader, GradientShader{}, drawOptions);
+				});
+		}
+	}
+
+	DrawOptions options;
+	options.pool = &pool;
+
+	CompareModes<FB>("culled", options, [&](FB& framebuffer, const DrawOptions& drawOptions) {
+		DrawTriangles<CulledState>(framebuffer, vertices, vShader, GradientShader{}, drawOptions);
+		});
+
+	CompareModes<LinearFB>("linear float", options, [&](LinearFB& framebuffer, const DrawOptions& drawOptions) {
+		DrawTriangles<OpaqueState>(framebuffer, vertices, vShader, GradientShader{}, drawOptions);
+		});
+
+	// Immediate and deferred fall back to streaming and binned
+	CompareModes<Multisampled>("msaa4", options, [&](Multisampled& framebuffer, const DrawOptions& drawOptions) {
+		DrawTriangles<OpaqueState>(framebuffer, vertices, vShader, GradientShader{}, drawOptions);
+		});
+
+	return TestResult();
+}
@@ -0,0 +1,238 @@
+// Multisampling against known results: the samples covered by triangles are those of the sample
+// pattern found inside the edges, with 4 and 8 samples in each raster mode, and Resolve() averages
+// the samples, the SIMD paths as the generic one.
+
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include "check.h"
+#include "framebuffer.h"
+#include "pipeline.h"
+#include "raster.h"
+
+// Power of two, so that vertices on the 1/16 pixel grid are exact in NDC and in window coordinates
+constexpr int kSize = 64;
+constexpr int kSteps = 16;
+
+constexpr RasterMode kModes[] = { RasterMode::Immediate, RasterMode::Streaming, RasterMode::Binned, RasterMode::Deferred };
+constexpr const char* kModeNames[] = { "immediate", "streaming", "binned", "deferred" };
+
+struct GridPoint {
+	int64_t x, y;	// Window coordinates in 1/16 of pixel
+};
+
+int64_t Edge(const GridPoint& a, const GridPoint& b, const GridPoint& p) {
+	return (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x);
+}
+
+// Samples of pixel (px, py) inside triangle abc, found with exact edge functions. Samples on an edge
+// depend on the fill rule and are set in ambiguous.
+template <int samples>
+uint32_t CoveredSamples(const GridPoint* tri, int px, int py, uint32_t& ambiguous) {
+	const int64_t area = Edge(tri[0], tri[1], tri[2]);
+	uint32_t covered = 0;
+	ambiguous = 0;
+	for (int s = 0; s < samples; ++s) {
+		const GridPoint p = { px * kSteps + kSteps / 2 + SamplePattern<samples>::x[s], py * kSteps + kSteps / 2 + SamplePattern<samples>::y[s] };
+		const int64_t e[3] = { Edge(tri[1], tri[2], p), Edge(tri[2], tri[0], p), Edge(tri[0], tri[1], p) };
+		if (e[0] == 0 || e[1] == 0 || e[2] == 0) {
+			ambiguous |= 1u << s;
+		}
+		else if ((e[0] > 0) == (area > 0) && (e[1] > 0) == (area > 0) && (e[2] > 0) == (area > 0)) {
+			covered |= 1u << s;
+		}
+	}
+	return covered;
+}
+
+// White triangles on black, one at a time: every sample and every resolved pixel against the pattern
+template <int samples>
+void CheckCoverage(ThreadPool& pool) {
+
+	using FB = BasicFramebuffer<ColorRGBA8, Depth24, TiledLayout<8>, samples>;
+	using Resolved = BasicFramebuffer<ColorRGBA8, Depth24>;
+
+	std::mt19937 rng(samples);
+	std::uniform_int_distribution<int64_t> coord(-4 * kSteps, (kSize + 4) * kSteps);
+	const CubeVertShader vShader;
+
+	for (size_t m = 0; m < std::size(kModes); ++m) {
+		int partial = 0;
+		int wrongSamples = 0;
+		int wrongResolved = 0;
+
+		for (int i = 0; i < 30; ++i) {
+			GridPoint tri[3];
+			do {
+				for (GridPoint& p : tri) {
+					p = { coord(rng), coord(rng) };
+				}
+			} while (Edge(tri[0], tri[1], tri[2]) == 0);
+
+			std::vector<TestVertIn> vertices;
+			const auto ndc = [](const GridPoint& p) {
+				return Vec2{ static_cast<float>(p.x) / (kSize * kSteps / 2) - 1.f, static_cast<float>(p.y) / (kSize * kSteps / 2) - 1.f };
+			};
+			AddTriangle(vertices, ndc(tri[0]), ndc(tri[1]), ndc(tri[2]), 0.f);
+
+			FB framebuffer(kSize, kSize);
+			framebuffer.clear({ 0.f, 0.f, 0.f, 1.f });
+			DrawOptions options;
+			options.mode = kModes[m];
+			options.pool = &pool;
+			options.tileSize = 16;
+			DrawTriangles<OpaqueState>(framebuffer, std::span<const TestVertIn>(vertices), vShader, ColorShader{ { 1.f, 1.f, 1.f, 1.f } }, options);
+
+			Resolved resolved(kSize, kSize);
+			Resolve(framebuffer, resolved, &pool);
+
+			for (int py = 0; py < kSize; ++py) {
+				for (int px = 0; px < kSize; ++px) {
+					uint32_t ambiguous;
+					const uint32_t covered = CoveredSamples<samples>(tri, px, py, ambiguous);
+					for (int s = 0; s < samples; ++s) {
+						const bool drawn = framebuffer.getColor(px, py, s).x == 1.f;
+						if (!(ambiguous & (1u << s)) && drawn != ((covered >> s) & 1)) {
+							++wrongSamples;
+						}
+					}
+					if (ambiguous == 0) {
+						const int count = std::popcount(covered);
+						partial += count > 0 && count < samples;
+						// Rounded to nearest, as in Resolve
+						const int expected = (255 * count + samples / 2) / samples;
+						if (resolved.colors[resolved.layout.index(px, py)][0] != expected) {
+							++wrongResolved;
+						}
+					}
+				}
+			}
+		}
+
+		if (wrongSamples != 0 || wrongResolved != 0) {
+			std::fprintf(stderr, "%d samples, %s: %d wrong samples, %d wrong resolved pixels\n", samples, kModeNames[m], wrongSamples, wrongResolved);
+		}
+		CHECK(wrongSamples == 0);
+		CHECK(wrongResolved == 0);
+		CHECK(partial > 100);
+	}
+}
+
+// Random sample colors resolved on the RGBA8 path, against the rounded average and against the
+// float path given the same colors
+template <int samples>
+void CheckResolveRGBA8(ThreadPool* pool) {
+
+	BasicFramebuffer<ColorRGBA8, Depth32F, LinearLayout, samples> bytes(kSize, kSize / 2);
+	BasicFramebuffer<ColorRGBA32F, Depth32F, LinearLayout, samples> floats(kSize, kSize / 2);
+	std::mt19937 rng(17 + samples);
+	std::uniform_int_distribution<int> value(0, 255);
+	for (size_t i = 0; i < bytes.colors.size(); ++i) {
+		for (int c = 0; c < 4; ++c) {
+			// Some pixels with every sample at 255, the largest sums
+			bytes.colors[i][c] = static_cast<uint8_t>(i / samples % 7 == 0 ? 255 : value(rng));
+		}
+		floats.colors[i] = ColorRGBA8::decode(bytes.colors[i]);
+	}
+
+	BasicFramebuffer<ColorRGBA8, Depth32F> resolvedBytes(kSize, kSize / 2);
+	BasicFramebuffer<ColorRGBA32F, Depth32F> resolvedFloats(kSize, kSize / 2);
+	Resolve(bytes, resolvedBytes, pool);
+	Resolve(floats, resolvedFloats, pool);
+
+	int wrong = 0;
+	int wrongFloat = 0;
+	int farFromFloat = 0;
+	for (int y = 0; y < bytes.h; ++y) {
+		for (int x = 0; x < bytes.w; ++x) {
+			const Vec4 average = resolvedFloats.getColor(x, y);
+			for (int c = 0; c < 4; ++c) {
+				int sum = 0;
+				for (int s = 0; s < samples; ++s) {
+					sum += bytes.colors[bytes.sampleIndex(x, y, s)][c];
+				}
+				const int got = resolvedBytes.colors[resolvedBytes.layout.index(x, y)][c];
+				wrong += got != (sum + samples / 2) / samples;
+				wrongFloat += std::abs(average[c] - sum / (255.f * samples)) > 1e-6f;
+				// Ties may round either way in floats
+				farFromFloat += std::abs(got - average[c] * 255.f) > 0.5f + 1e-4f;
+			}
+		}
+	}
+	if (wrong != 0 || wrongFloat != 0 || farFromFloat != 0) {
+		std::fprintf(stderr, "resolve %d samples: %d wrong bytes, %d wrong floats, %d bytes off the float average\n", samples, wrong, wrongFloat, farFromFloat);
+	}
+	CHECK(wrong == 0);
+	CHECK(wrongFloat == 0);
+	CHECK(farFromFloat == 0);
+}
+
+// Formats without a SIMD path are decoded, averaged and encoded again
+template <int samples>
+void CheckResolveGeneric(ThreadPool* pool) {
+
+	BasicFramebuffer<ColorRGB10A2, Depth32F, LinearLayout, samples> src(kSize, kSize / 2);
+	std::mt19937 rng(31 + samples);
+	std::uniform_int_distribution<uint32_t> value;
+	for (uint32_t& color : src.colors) {
+		color = value(rng);
+	}
+
+	BasicFramebuffer<ColorRGB10A2, Depth32F> dst(kSize, kSize / 2);
+	Resolve(src, dst, pool);
+
+	int wrong = 0;
+	for (int y = 0; y < src.h; ++y) {
+		for (int x = 0; x < src.w; ++x) {
+			const Vec4 got = dst.getColor(x, y);
+			for (int c = 0; c < 4; ++c) {
+				double sum = 0.;
+				for (int s = 0; s < samples; ++s) {
+					sum += src.getColor(x, y, s)[c];
+				}
+				// Half a step of the channel, 2 bits for alpha
+				const double tolerance = (c == 3 ? 0.5 / 3. : 0.5 / 1023.) + 1e-6;
+				wrong += std::abs(got[c] - sum / samples) > tolerance;
+			}
+		}
+	}
+	if (wrong != 0) {
+		std::fprintf(stderr, "generic resolve %d samples: %d wrong channels\n", samples, wrong);
+	}
+	CHECK(wrong == 0);
+}
+
+int main() {
+
+	ThreadPool pool(4);
+
+	CheckCoverage<4>(pool);
+	CheckCoverage<8>(pool);
+
+	for (ThreadPool* resolvePool : { &pool, static_cast<ThreadPool*>(nullptr) }) {
+		CheckResolveRGBA8<4>(resolvePool);
+		CheckResolveRGBA8<8>(resolvePool);
+		CheckResolveGeneric<4>(resolvePool);
+		CheckResolveGeneric<8>(resolvePool);
+	}
+
+	// Sizes must match
+	BasicFramebuffer<ColorRGBA8, Depth32F, LinearLayout, 4> src(kSize, kSize);
+	BasicFramebuffer<ColorRGBA8, Depth32F> smaller(kSize, kSize - 1);
+	bool threw = false;
+	try {
+		Resolve(src, smaller);
+	}
+	catch (const std::invalid_argument&) {
+		threw = true;
+	}
+	CHECK(threw);
+
+	return TestResult();
+}
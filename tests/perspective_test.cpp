@@ -0,0 +1,112 @@
+// Perspective correct interpolation: the texture coordinates interpolated at each pixel of triangles
+// slanted in depth, clipped or not, against those of the point hit by the ray through the pixel
+// center.
+
+#include <cmath>
+#include <cstdio>
+#include <span>
+#include <vector>
+
+#include "check.h"
+#include "framebuffer.h"
+#include "pipeline.h"
+
+using FB = BasicFramebuffer<ColorRGBA32F, Depth32F>;
+
+constexpr RasterMode kModes[] = { RasterMode::Immediate, RasterMode::Streaming, RasterMode::Binned, RasterMode::Deferred };
+constexpr const char* kModeNames[] = { "immediate", "streaming", "binned", "deferred" };
+
+struct SlantedTriangle {
+	const char* name;
+	Vec3 a, b, c;	// View space, with texture coordinates (0, 0), (1, 0) and (0, 1)
+};
+
+int main() {
+
+	const PerspectiveCamera camera{ 160, 120 };
+	CubeVertShader vShader;
+	vShader.projection = camera.projection();
+
+	const SlantedTriangle triangles[] = {
+		{ "slanted", { -2.f, -1.f, -1.5f }, { 2.f, -1.f, -8.f }, { -1.f, 2.f, -12.f } },
+		// c is behind the camera, the coordinates of the clipped vertices are interpolated too
+		{ "near_clipped", { -1.f, -1.f, -4.f }, { 2.f, -0.5f, -3.f }, { 0.f, 0.8f, 1.f } },
+	};
+
+	// Coordinates of the point hit through window point (x, y)
+	const auto expected = [&](const SlantedTriangle& tri, double x, double y) {
+		double t, u, v;
+		camera.hit(tri.a, tri.b, tri.c, x, y, t, u, v);
+		return std::pair{ u, v };
+	};
+
+	for (const SlantedTriangle& tri : triangles) {
+		const std::vector<TestVertIn> vertices = {
+			{ tri.a, Vec2{ 0.f, 0.f } },
+			{ tri.b, Vec2{ 1.f, 0.f } },
+			{ tri.c, Vec2{ 0.f, 1.f } },
+		};
+
+		for (size_t m = 0; m < std::size(kModes); ++m) {
+			DrawOptions options;
+			options.mode = kModes[m];
+			FB framebuffer(camera.w, camera.h);
+			framebuffer.clear({ 0.f, 0.f, 0.f, 0.f });
+			DrawTriangles<OpaqueState>(framebuffer, std::span<const TestVertIn>(vertices), vShader, GradientShader{}, options);
+
+			int covered = 0;
+			int wrong = 0;
+			double maxError = 0.;
+			for (int py = 0; py < camera.h; ++py) {
+				for (int px = 0; px < camera.w; ++px) {
+					bool ambiguous;
+					double t, u, v;
+					if (!camera.covers(tri.a, tri.b, tri.c, px, py, ambiguous, t, u, v) || ambiguous) {
+						continue;
+					}
+					++covered;
+
+					// Snapping the vertices to 1/16 of pixel moves the coordinates by up to their
+					// slope over that distance
+					const auto [ux, vx] = expected(tri, px + 1.5, py + 0.5);
+					const auto [uy, vy] = expected(tri, px + 0.5, py + 1.5);
+					const double tolerance = 1e-5 + (std::abs(ux - u) + std::abs(uy - u) + std::abs(vx - v) + std::abs(vy - v)) / 16.;
+
+					const Vec4 color = framebuffer.getColor(px, py);
+					const double error = std::max(std::abs(color.x - u), std::abs(color.y - v));
+					maxError = std::max(maxError, error);
+					if (error > tolerance) {
+						++wrong;
+					}
+				}
+			}
+
+			if (wrong != 0 || covered < 1000) {
+				std::fprintf(stderr, "%s, %s: %d pixels covered, %d wrong, max error %g\n", tri.name, kModeNames[m], covered, wrong, maxError);
+			}
+			CHECK(wrong == 0);
+			CHECK(covered >= 1000);
+		}
+	}
+
+	// The vertices shaded one by one are those of the batches, bit for bit
+	CubeVertShader moved = vShader;
+	moved.model = rotation(0.7f, normalize(Vec3{ 1.f, 2.f, 3.f }));
+	moved.view = lookAt({ 0.3f, 1.f, 4.f }, { 0.f, 0.f, -2.f }, { 0.f, 1.f, 0.f });
+	moved.prepare();
+	const std::vector<TestVertIn> shaded = RandomTriangles(100, 5);
+	std::vector<Vertex<Vec2>> batch(shaded.size());
+	moved.shadeBatch(shaded, batch);
+	int different = 0;
+	for (size_t i = 0; i < shaded.size(); ++i) {
+		const Vec4 one = moved(std::get<0>(shaded[i]), std::get<1>(shaded[i])).pos;
+		const Vec4& many = batch[i].pos;
+		different += one.x != many.x || one.y != many.y || one.z != many.z || one.w != many.w;
+	}
+	if (different != 0) {
+		std::fprintf(stderr, "%d vertices differ between operator() and shadeBatch()\n", different);
+	}
+	CHECK(different == 0);
+
+	return TestResult();
+}
@@ -0,0 +1,82 @@
+// ThreadPool: exceptions thrown by the calls reach the caller of parallelFor, from the calling
+// thread and from the workers, and the pool keeps working in parallel afterwards.
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+
+#include "check.h"
+#include "threadpool.h"
+
+using namespace std::chrono_literals;
+
+// Workers that ran some call of a job long enough for all of them to wake up
+std::set<int> WorkersUsed(ThreadPool& pool) {
+	std::mutex mutex;
+	std::set<int> used;
+	pool.parallelFor(16, [&](int, int worker) {
+		std::this_thread::sleep_for(5ms);
+		std::lock_guard lock(mutex);
+		used.insert(worker);
+		});
+	return used;
+}
+
+// parallelFor(count, fn) throws a std::runtime_error
+template <typename Fn>
+bool Throws(ThreadPool& pool, int count, Fn&& fn) {
+	try {
+		pool.parallelFor(count, fn);
+	}
+	catch (const std::runtime_error&) {
+		return true;
+	}
+	return false;
+}
+
+int main() {
+
+	ThreadPool pool(4);
+	CHECK(WorkersUsed(pool).size() > 1);
+
+	// From the calling thread, while the workers run other calls
+	std::atomic<int> calls = 0;
+	CHECK(Throws(pool, 64, [&](int, int worker) {
+		++calls;
+		if (worker == 0) {
+			throw std::runtime_error("caller");
+		}
+		std::this_thread::sleep_for(1ms);
+		}));
+	CHECK(calls < 64);
+	CHECK(WorkersUsed(pool).size() > 1);
+
+	// From a worker, the calling thread waits for it
+	std::atomic<bool> thrown = false;
+	CHECK(Throws(pool, 64, [&](int, int worker) {
+		if (worker != 0) {
+			thrown = true;
+			throw std::runtime_error("worker");
+		}
+		const auto start = std::chrono::steady_clock::now();
+		while (!thrown && std::chrono::steady_clock::now() - start < 2s) {
+			std::this_thread::sleep_for(1ms);
+		}
+		}));
+	CHECK(thrown);
+	CHECK(WorkersUsed(pool).size() > 1);
+
+	// Serial runs throw as they are
+	CHECK(Throws(pool, 1, [](int, int) { throw std::runtime_error("single"); }));
+	ThreadPool single(1);
+	CHECK(Throws(single, 8, [](int index, int) {
+		if (index == 3) {
+			throw std::runtime_error("single");
+		}
+		}));
+
+	return TestResult();
+}